@@ -0,0 +1,31 @@
+#pragma once
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <limits>
+
+namespace polyp {
+namespace bench {
+
+/// Best wall time of fn() over the runs in milliseconds, after one warm-up call
+template<typename F>
+double measure(uint32_t runs, F&& fn)
+{
+    fn();
+
+    double best = std::numeric_limits<double>::max();
+    for (uint32_t i = 0; i < runs; ++i)
+    {
+        const auto begin = std::chrono::steady_clock::now();
+        fn();
+        const auto end   = std::chrono::steady_clock::now();
+
+        best = std::min(best, std::chrono::duration<double, std::milli>(end - begin).count());
+    }
+
+    return best;
+}
+
+} // namespace bench
+} // namespace polyp
@@ -0,0 +1,67 @@
+#include "bench.h"
+
+#include <culling.h>
+#include <jobs.h>
+
+#include <glm/gtc/matrix_transform.hpp>
+
+#include <cstdio>
+#include <random>
+
+using namespace polyp;
+
+namespace {
+
+constexpr uint32_t kRuns = 20;
+
+/// Spheres scattered in a cube around the camera, about a tenth of them in the view
+BoundsSoA scatter(size_t count)
+{
+    std::mt19937                          random(42);
+    std::uniform_real_distribution<float> position(-500.0f, 500.0f);
+    std::uniform_real_distribution<float> radius(0.5f, 2.0f);
+
+    BoundsSoA bounds;
+    bounds.reserve(count);
+
+    for (size_t i = 0; i < count; ++i)
+        bounds.push({ position(random), position(random), position(random) }, radius(random));
+
+    return bounds;
+}
+
+} // namespace
+
+int main()
+{
+    const auto projection = glm::perspective(glm::radians(60.0f), 16.0f / 9.0f, 0.1f, 1000.0f);
+    const auto view       = glm::lookAt(glm::vec3(0.0f), glm::vec3(0.0f, 0.0f, -1.0f), glm::vec3(0.0f, 1.0f, 0.0f));
+    const auto frustum    = Frustum::fromMatrix(projection * view);
+
+    std::printf("CPU culling, %u threads\n", JobSystem::get().threads());
+    std::printf("%10s %10s %12s %12s %9s\n", "spheres", "visible", "scalar, ms", "cull, ms", "speedup");
+
+    bool matches = true;
+
+    for (size_t count : { 10'000u, 100'000u, 1'000'000u })
+    {
+        const auto bounds = scatter(count);
+
+        std::vector<uint32_t> reference, visible;
+        reference.reserve(count);
+        visible.reserve(count);
+
+        const double scalar = bench::measure(kRuns, [&]() { cullScalar(frustum, bounds, reference); });
+        const double simd   = bench::measure(kRuns, [&]() { cull(frustum, bounds, visible); });
+
+        std::printf("%10zu %10zu %12.3f %12.3f %8.2fx\n", count, visible.size(), scalar, simd, scalar / simd);
+
+        if (visible != reference)
+        {
+            std::printf("cull() and cullScalar() disagree on %zu spheres\n", count);
+            matches = false;
+        }
+    }
+
+    return matches ? 0 : 1;
+}
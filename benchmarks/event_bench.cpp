@@ -0,0 +1,86 @@
+#include "bench.h"
+#include "legacy_event.h"
+
+#include <event.h>
+
+#include <cstdio>
+#include <vector>
+
+using namespace polyp;
+
+namespace {
+
+constexpr uint32_t kRuns       = 10;
+constexpr uint32_t kDispatches = 1'000'000;
+
+struct Args
+{
+    int value = 1;
+};
+
+struct Listener
+{
+    int sum = 0;
+
+    void onEvent(const Args& args) { sum += args.value; }
+};
+
+/// Half of the listeners are lambdas, the other half bound member functions, as in the samples
+template<typename TEvent>
+void subscribe(TEvent& event, std::vector<Listener>& listeners)
+{
+    for (size_t i = 0; i < listeners.size(); ++i)
+    {
+        auto* listener = &listeners[i];
+
+        if (i % 2 == 0)
+            event += [listener](const Args& args) { listener->sum += args.value; };
+        else
+            event.bind(&Listener::onEvent, listener);
+    }
+}
+
+/// Nanoseconds per dispatch
+template<typename TEvent>
+double dispatch(TEvent& event)
+{
+    const Args args;
+
+    return bench::measure(kRuns, [&]() {
+        for (uint32_t i = 0; i < kDispatches; ++i)
+            event(args);
+    }) * 1e6 / kDispatches;
+}
+
+} // namespace
+
+int main()
+{
+    std::printf("Event dispatch, %u calls\n", kDispatches);
+    std::printf("%10s %12s %12s %9s\n", "listeners", "legacy, ns", "inline, ns", "speedup");
+
+    int checksum = 0;
+
+    for (size_t count : { 1u, 4u, 16u })
+    {
+        std::vector<Listener> legacyListeners(count);
+        std::vector<Listener> listeners(count);
+
+        legacy::Event<void(const Args&)> legacyEvent;
+        Event<void(const Args&)>         event;
+
+        subscribe(legacyEvent, legacyListeners);
+        subscribe(event, listeners);
+
+        const double legacyTime = dispatch(legacyEvent);
+        const double time       = dispatch(event);
+
+        std::printf("%10zu %12.2f %12.2f %8.2fx\n", count, legacyTime, time, legacyTime / time);
+
+        for (size_t i = 0; i < count; ++i)
+            checksum += legacyListeners[i].sum - listeners[i].sum;
+    }
+
+    // Both events reach every listener the same number of times
+    return checksum == 0 ? 0 : 1;
+}
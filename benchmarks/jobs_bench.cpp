@@ -0,0 +1,142 @@
+#include "bench.h"
+
+#include <jobs.h>
+
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <thread>
+#include <vector>
+
+#ifdef _WIN32
+    #define popen  _popen
+    #define pclose _pclose
+#endif
+
+using namespace polyp;
+
+namespace {
+
+constexpr uint32_t kRuns        = 10;
+constexpr uint32_t kItems       = 1 << 22;
+constexpr uint32_t kGrain       = 4096;
+constexpr uint32_t kDepth       = 12;   // fork-join tree of 4096 leaves
+constexpr uint32_t kLeafWork    = 2048; // iterations of a leaf job
+
+float work(uint32_t seed, uint32_t iterations)
+{
+    float value = static_cast<float>(seed);
+    for (uint32_t i = 0; i < iterations; ++i)
+        value = std::sqrt(value * 1.0001f + 1.0f);
+
+    return value;
+}
+
+/// Halves the leaves down to single ones, every level queues one half and runs the other
+void forkJoin(std::vector<float>& leaves, uint32_t begin, uint32_t end)
+{
+    if (end - begin == 1)
+    {
+        leaves[begin] = work(begin, kLeafWork);
+        return;
+    }
+
+    const uint32_t middle = begin + (end - begin) / 2;
+
+    auto&      jobs = JobSystem::get();
+    JobCounter counter;
+    jobs.run(counter, [&leaves, middle, end]() { forkJoin(leaves, middle, end); });
+    forkJoin(leaves, begin, middle);
+    jobs.wait(counter);
+}
+
+/// Times both workloads with the workers of this process and prints "<threads> <parallelFor ms> <fork-join ms>"
+int measureWorkers()
+{
+    std::vector<float> items(kItems);
+    std::vector<float> leaves(1u << kDepth);
+
+    auto& jobs = JobSystem::get();
+
+    const double parallelFor = bench::measure(kRuns, [&]() {
+        jobs.parallelFor(kItems, kGrain, [&items](uint32_t begin, uint32_t end) {
+            for (uint32_t i = begin; i < end; ++i)
+                items[i] = work(i, 16);
+        });
+    });
+
+    const double nested = bench::measure(kRuns, [&]() { forkJoin(leaves, 0, static_cast<uint32_t>(leaves.size())); });
+
+    std::printf("%u %f %f\n", jobs.threads(), parallelFor, nested);
+    return 0;
+}
+
+bool setWorkers(uint32_t workers)
+{
+    const auto value = std::to_string(workers);
+#ifdef _WIN32
+    return _putenv_s("POLYP_JOB_WORKERS", value.c_str()) == 0;
+#else
+    return setenv("POLYP_JOB_WORKERS", value.c_str(), 1) == 0;
+#endif
+}
+
+} // namespace
+
+/// The job system's workers are fixed for a process, so every worker count runs in a child process
+/// started with POLYP_JOB_WORKERS set. 0 workers runs everything on the main thread and is the baseline of the
+/// speedups. The optional argument is the largest count, the hardware threads but one by default.
+int main(int argc, char** argv)
+{
+    if (argc > 1 && std::strcmp(argv[1], "--measure") == 0)
+        return measureWorkers();
+
+    const uint32_t maxWorkers = argc > 1 ? static_cast<uint32_t>(std::atoi(argv[1]))
+                                         : std::max(std::thread::hardware_concurrency(), 2u) - 1;
+
+#ifdef _WIN32
+    // cmd.exe strips the outer quotes of the command
+    const std::string command = "\"\"" + std::string(argv[0]) + "\" --measure\"";
+#else
+    const std::string command = "\"" + std::string(argv[0]) + "\" --measure";
+#endif
+
+    std::printf("Job system scaling, %u items in ranges of %u, fork-join tree of %u leaves\n", kItems, kGrain, 1u << kDepth);
+    std::printf("%8s %8s %16s %9s %16s %9s\n", "workers", "threads", "parallelFor, ms", "speedup", "fork-join, ms", "speedup");
+
+    double baseFor  = 0.0;
+    double baseFork = 0.0;
+
+    for (uint32_t workers = 0; workers <= maxWorkers; ++workers)
+    {
+        if (!setWorkers(workers))
+            return 1;
+
+        FILE* child = popen(command.c_str(), "r");
+        if (child == nullptr)
+            return 1;
+
+        uint32_t threads     = 0;
+        double   parallelFor = 0.0;
+        double   nested      = 0.0;
+        const bool read = std::fscanf(child, "%u %lf %lf", &threads, &parallelFor, &nested) == 3;
+
+        if (pclose(child) != 0 || !read)
+        {
+            std::printf("The measurement with %u workers failed\n", workers);
+            return 1;
+        }
+
+        if (workers == 0)
+        {
+            baseFor  = parallelFor;
+            baseFork = nested;
+        }
+
+        std::printf("%8u %8u %16.3f %8.2fx %16.3f %8.2fx\n", workers, threads, parallelFor, baseFor / parallelFor, nested, baseFork / nested);
+    }
+
+    return 0;
+}
@@ -16,8 +16,14 @@ if(CMAKE_SIZEOF_VOID_P EQUAL 8 AND EXISTS "${VK_SDK_PATH}/Bin/glslangValidator.e
 elseif(CMAKE_SIZEOF_VOID_P EQUAL 4 AND EXISTS "${VK_SDK_PATH}/Bin32/glslangValidator.exe")
     message(VERBOSE "Using 32-bit glslangValidator")
     set(GLSL_VALIDATOR "$ENV{VULKAN_SDK}/Bin32/glslangValidator.exe" CACHE PATH "Path to glslangValidator")
+elseif(EXISTS "${VK_SDK_PATH}/bin/glslangValidator")
+    message(VERBOSE "Using glslangValidator from ${VK_SDK_PATH}/bin")
+    set(GLSL_VALIDATOR "${VK_SDK_PATH}/bin/glslangValidator" CACHE PATH "Path to glslangValidator")
 else()
-    message(ERROR "Failed to find glslangValidator")
+    find_program(GLSL_VALIDATOR glslangValidator)
+    if(NOT GLSL_VALIDATOR)
+        message(ERROR "Failed to find glslangValidator")
+    endif()
 endif()
 
 #SET(VULKANSDK_INCLUDE_DIR "${VK_SDK_PATH}/Include" CACHE PATH "Path to the vulkan.h header file")
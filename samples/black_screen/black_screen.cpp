@@ -15,9 +15,7 @@ protected:
 
     void draw() override
     {
-        RHIContext::get().device().waitIdle(); // Simply make sure that the cmd is not in a pending stage
-
-        CommandBuffer& cmd = mDrawCmds[mCurrSwImIndex];
+        CommandBuffer& cmd = mDrawCmds[mCurrFrameIndex];
 
         vk::CommandBufferBeginInfo beginInfo{};
         beginInfo.flags = vk::CommandBufferUsageFlagBits::eOneTimeSubmit;
@@ -30,7 +28,7 @@ protected:
         barrier.srcAccessMask                   = vk::AccessFlagBits::eNone;
         barrier.dstAccessMask                   = vk::AccessFlagBits::eMemoryRead;
         barrier.oldLayout                       = vk::ImageLayout::eUndefined;
-        barrier.newLayout                       = vk::ImageLayout::ePresentSrcKHR;
+        barrier.newLayout                       = RHIContext::get().presentLayout();
         barrier.srcQueueFamilyIndex             = VK_QUEUE_FAMILY_IGNORED;
         barrier.dstQueueFamilyIndex             = VK_QUEUE_FAMILY_IGNORED;
         barrier.subresourceRange.aspectMask     = vk::ImageAspectFlagBits::eColor;
@@ -39,7 +37,8 @@ protected:
         barrier.subresourceRange.baseArrayLayer = 0;
         barrier.subresourceRange.layerCount     = VK_REMAINING_ARRAY_LAYERS;
         
-        cmd.pipelineBarrier(vk::PipelineStageFlagBits::eTopOfPipe,
+        // Chained with the acquire semaphore wait stage, so the transition happens after the image is acquired
+        cmd.pipelineBarrier(vk::PipelineStageFlagBits::eColorAttachmentOutput,
                             vk::PipelineStageFlagBits::eBottomOfPipe,
                             vk::DependencyFlags(), nullptr, nullptr, barrier);
 
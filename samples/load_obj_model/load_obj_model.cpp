@@ -20,7 +20,8 @@ protected:
     RHIContext::CreateInfo getRHICreateInfo() override
     {
         auto info = utils::getCreateInfo<RHIContext::CreateInfo>();
-        info.device.features.fillModeNonSolid = true;
+        info.device.features.fillModeNonSolid  = true;
+        info.device.features.multiDrawIndirect = true;
         return info;
     }
 
@@ -32,6 +33,11 @@ protected:
         return std::make_tuple(std::move(vert), std::move(index));
     }
 
+    ShaderModule loadCullingShader() override
+    {
+        return utils::loadSPIRV("shaders/load_obj_model/culling.comp.spv");
+    }
+
     ModelsData loadModel() override
     {
         std::string path = gModelPath;
@@ -59,8 +65,7 @@ protected:
             vertexData[i].position[0] = positions[i].x;
             vertexData[i].position[1] = positions[i].y;
             vertexData[i].position[2] = positions[i].z;
-            memcpy_s(vertexData[i].color, sizeof(vertexData[i].color),
-                     defaultColor,        sizeof(defaultColor));
+            std::memcpy(vertexData[i].color, defaultColor, sizeof(defaultColor));
         }
 
         return std::make_tuple(std::move(vertexData), std::move(indices));
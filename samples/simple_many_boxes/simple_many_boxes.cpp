@@ -2,6 +2,10 @@
 
 #include <random>
 
+#ifndef POLYP_BOX_COUNT
+#define POLYP_BOX_COUNT 1000 // instanced, so even 1M boxes cost only their transforms
+#endif // !POLYP_BOX_COUNT
+
 using namespace polyp;
 using namespace polyp::vulkan;
 
@@ -18,7 +22,9 @@ public:
 protected:
     RHIContext::CreateInfo getRHICreateInfo() override
     {
-        return utils::getCreateInfo<RHIContext::CreateInfo>();
+        auto info = utils::getCreateInfo<RHIContext::CreateInfo>();
+        info.device.features.multiDrawIndirect = true;
+        return info;
     }
 
     ShadersData loadShaders() override
@@ -29,6 +35,11 @@ protected:
         return std::make_tuple(std::move(vert), std::move(index));
     }
 
+    ShaderModule loadCullingShader() override
+    {
+        return utils::loadSPIRV("shaders/simple_many_boxes/culling.comp.spv");
+    }
+
     ModelsData loadModel() override
     {
         float vertices[] =
@@ -97,101 +108,27 @@ protected:
 
         std::iota(indexData.begin(), indexData.end(), 0);
 
-        std::vector<Vertex> vertexData;
-        for (size_t i = 0; i < mBoxCount; ++i)
-        {
-            glm::mat4 model = glm::mat4(1.0f);
-            model           = glm::translate(model, mBoxPositions[i]);
-            float angle     = rand() % 360;
-            model           = glm::rotate(model, glm::radians(angle), glm::vec3(1.0f, 0.3f, 0.5f));
-
-            for (size_t v = 0; v < cubeVertices.size(); ++v)
-            {
-                auto data = cubeVertices[v];
-                glm::vec4 transformed = model * glm::vec4(data.position[0], data.position[1], data.position[2], 1.0);
-
-                data.position[0] = transformed.x;
-                data.position[1] = transformed.y;
-                data.position[2] = transformed.z;
-
-                vertexData.push_back(data);
-            }
-        }
-
-        POLYPASSERT((vertexData.size() % mBoxCount) == 0 &&
-                    (vertexData.size() / mBoxCount) == indexData.size());
-
         mCamera.reset(glm::vec3(0.0, 0.0, (mDeviation * 5)), glm::vec3(0.0, 0.0, 0.0));
 
-        return std::make_tuple(std::move(vertexData), std::move(indexData));
+        return std::make_tuple(std::move(cubeVertices), std::move(indexData));
     }
 
-    void draw() override
+    /// One cube in the geometry heap, every box is an instance of it with its own transform
+    std::vector<Instance> loadInstances() override
     {
-        CommandBuffer& cmd = mDrawCmds[mCurrSwImIndex];
-
-        vk::CommandBufferBeginInfo beginInfo{};
-        beginInfo.flags = vk::CommandBufferUsageFlagBits::eOneTimeSubmit;
-
-        const auto& ctx = RHIContext::get();
-        auto capabilities = ctx.gpu().getSurfaceCapabilitiesKHR(*ctx.surface());
+        std::vector<Instance> instances(mBoxCount);
 
-        const uint32_t width  = capabilities.currentExtent.width;
-        const uint32_t height = capabilities.currentExtent.height;
-
-        vk::ClearValue clearValues[2];
-        clearValues[0].color        = vk::ClearColorValue{ 0.4f, 0.4f, 0.4f, 1.0f };
-        clearValues[1].depthStencil = vk::ClearDepthStencilValue{ 1.0f, 0 };
-
-        vk::RenderPassBeginInfo renderPassBeginInfo{};
-        renderPassBeginInfo.renderPass               = *mRenderPass;
-        renderPassBeginInfo.renderArea.offset.x      = 0;
-        renderPassBeginInfo.renderArea.offset.y      = 0;
-        renderPassBeginInfo.renderArea.extent.width  = width;
-        renderPassBeginInfo.renderArea.extent.height = height;
-        renderPassBeginInfo.clearValueCount          = 2;
-        renderPassBeginInfo.pClearValues             = clearValues;
-        renderPassBeginInfo.framebuffer              = *mFrameBuffers[mCurrSwImIndex];
-
-        cmd.begin(beginInfo);
-        cmd.beginRenderPass(renderPassBeginInfo, SubpassContents::eInline);
-
-        vk::Viewport viewport{};
-        viewport.height   = (float)height;
-        viewport.width    = (float)width;
-        viewport.minDepth = (float)0.0f;
-        viewport.maxDepth = (float)1.0f;
-
-        std::vector<vk::Viewport> viewpors{ viewport };
-        cmd.setViewport(0, viewpors);
-
-        vk::Rect2D scissor{};
-        scissor.extent.width  = width;
-        scissor.extent.height = height;
-        scissor.offset.x      = 0;
-        scissor.offset.y      = 0;
-
-        std::vector<vk::Rect2D> scissors{ scissor };
-        cmd.setScissor(0, scissors);
-
-        std::vector<uint32_t> dynamicOffsets{ static_cast<uint32_t>(sizeof(MVP)) * mCurrSwImIndex };
-
-        cmd.bindDescriptorSets(vk::PipelineBindPoint::eGraphics, *mPipelineLayout, 0, { *mDescriptorSet }, dynamicOffsets);
-        cmd.bindPipeline(vk::PipelineBindPoint::eGraphics, *mPipeline);
-        cmd.bindIndexBuffer(*mIndexBuffer, 0, vk::IndexType::eUint32);
-
-        const size_t boxesCount = mBoxPositions.size();
-        for (size_t i = 0; i < boxesCount; i++)
+        for (size_t i = 0; i < mBoxCount; ++i)
         {
-            VkDeviceSize offset = ((mVertexData.size() / boxesCount) * sizeof(decltype(mVertexData)::value_type)) * i;
-            cmd.bindVertexBuffers(0, { *mVertexBuffer }, { offset });
-            cmd.drawIndexed(mIndexData.size(), 1, 0, 0, 1);
-        }
+            glm::mat4 model = glm::mat4(1.0f);
+            model           = glm::translate(model, mBoxPositions[i]);
+            float angle     = rand() % 360;
+            model           = glm::rotate(model, glm::radians(angle), glm::vec3(1.0f, 0.3f, 0.5f));
 
-        cmd.endRenderPass();
-        cmd.end();
+            instances[i].model = model;
+        }
 
-        example::ExampleA::updateUniformBuffer();
+        return instances;
     }
 
 private:
@@ -215,7 +152,7 @@ private:
     }
 
     std::vector<glm::vec3> mBoxPositions;
-    const uint32_t mBoxCount = 1000;
+    const uint32_t mBoxCount = POLYP_BOX_COUNT;
     const float mDeviation = 5.0f;
 };
 
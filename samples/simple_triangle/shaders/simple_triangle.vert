@@ -2,6 +2,7 @@
 
 layout (location = 0) in vec3 inPos;
 layout (location = 1) in vec3 inColor;
+layout (location = 2) in mat4 inModel; // per instance
 
 layout (binding = 0) uniform UBO 
 {
@@ -15,5 +16,5 @@ layout (location = 0) out vec3 outColor;
 void main() 
 {
 	outColor = inColor;
-	gl_Position = ubo.projectionMatrix * ubo.viewMatrix * ubo.modelMatrix * vec4(inPos.xyz, 1.0);
+	gl_Position = ubo.projectionMatrix * ubo.viewMatrix * ubo.modelMatrix * inModel * vec4(inPos.xyz, 1.0);
 }
@@ -1,23 +1,22 @@
 #include "example_a.h"
 
+#include <limits>
+
 namespace polyp {
 namespace vulkan {
 namespace example {
 
 bool ExampleA::postInit()
 {
-    mTransferCmd = utils::createCommandBuffer(mCmdPool, vk::CommandBufferLevel::ePrimary);
-    if (*mTransferCmd == VK_NULL_HANDLE)
-        return false;
-
-    POLYPDEBUG("Primary command buffers created successfully");
-
     std::tie(mVertexData, mIndexData) = loadModel();
+    mInstanceData = loadInstances();
 
     createBuffers();
     createLayouts();
     createDS();
     createPipeline();
+    createCulling();
+    createBaked();
 
     POLYPDEBUG("Initialization finished");
 
@@ -26,28 +25,44 @@ bool ExampleA::postInit()
 
 bool ExampleA::postResize()
 {
-    const auto& gpu     = RHIContext::get().gpu();
-    const auto& surface = RHIContext::get().surface();
-    const auto& device  = RHIContext::get().device();
+    auto& ctx           = RHIContext::get();
+    const auto& device  = ctx.device();
+    const auto extent   = ctx.extent();
+    const auto format   = ctx.colorFormat();
 
-    auto [image, view]  = utils::createDepthStencil();
-    if (*image == VK_NULL_HANDLE  || *view == VK_NULL_HANDLE)
+    // Only the depth attachment depends on the extent
+    if (*mDepthStencil.image == VK_NULL_HANDLE || mAttachmentsInfo.extent != extent)
     {
-        POLYPERROR("Internal error: failed to create depth resources.");
-        return false;
-    }
+        auto [image, view]  = utils::createDepthStencil();
+        if (*image == VK_NULL_HANDLE  || *view == VK_NULL_HANDLE)
+        {
+            POLYPERROR("Internal error: failed to create depth resources.");
+            return false;
+        }
 
-    mDepthStencil.image = std::move(image);
-    mDepthStencil.view  = std::move(view);
+        ctx.retire(std::move(mDepthStencil.view));
+        ctx.retire(std::move(mDepthStencil.image));
+        mDepthStencil.image = std::move(image);
+        mDepthStencil.view  = std::move(view);
+    }
 
-    mRenderPass = utils::createRenderPass();
-    if (*mRenderPass == VK_NULL_HANDLE)
+    // The render pass and the pipeline built against it depend only on the color format
+    if (*mRenderPass == VK_NULL_HANDLE || mAttachmentsInfo.format != format)
     {
-        POLYPERROR("Internal error: failed to create render pass.");
-        return false;
+        ctx.retire(std::move(mRenderPass));
+        mRenderPass = utils::createRenderPass();
+        if (*mRenderPass == VK_NULL_HANDLE)
+        {
+            POLYPERROR("Internal error: failed to create render pass.");
+            return false;
+        }
+
+        if (*mPipeline != VK_NULL_HANDLE)
+            createPipeline();
     }
 
-    auto capabilities = gpu.getSurfaceCapabilitiesKHR(*surface);
+    mAttachmentsInfo.extent = extent;
+    mAttachmentsInfo.format = format;
 
     if (mSwapChainViews.empty())
     {
@@ -55,6 +70,7 @@ bool ExampleA::postResize()
         return false;
     }
 
+    ctx.retire(std::move(mFrameBuffers));
     mFrameBuffers.clear();
 
     for (auto i = 0; i < mSwapChainViews.size(); ++i)
@@ -67,8 +83,8 @@ bool ExampleA::postResize()
         fbCreateInfo.renderPass      = *mRenderPass;
         fbCreateInfo.attachmentCount = attachments.size();
         fbCreateInfo.pAttachments    = attachments.data();
-        fbCreateInfo.width           = capabilities.currentExtent.width;
-        fbCreateInfo.height          = capabilities.currentExtent.height;
+        fbCreateInfo.width           = extent.width;
+        fbCreateInfo.height          = extent.height;
         fbCreateInfo.layers          = 1;
 
         auto fb = device.createFramebuffer(fbCreateInfo);
@@ -81,14 +97,30 @@ bool ExampleA::postResize()
         mFrameBuffers.push_back(std::move(fb));
     }
 
+    // The viewport and the scissor are recorded with the extent
+    markDirty();
+
     return true;
 }
 
 void ExampleA::draw()
 {
+    updateUniformBuffer();
+
     prepareDrawCommands();
 
-    updateUniformBuffer();
+    if (POLYP_CULLING_REPORT_FRAMES > 0 && ++mCullingFrames % POLYP_CULLING_REPORT_FRAMES == 0)
+    {
+        if (mCulling)
+        {
+            const auto stats = mCulling.stats();
+            POLYPINFO("Culling: %u of %u objects visible", stats.visible, stats.objects);
+        }
+        else if (mCPUCulling.bounds.size() > 0)
+        {
+            POLYPINFO("CPU culling: %u of %zu instances visible", mCPUCulling.count, mCPUCulling.bounds.size());
+        }
+    }
 }
 
 RHIContext::CreateInfo ExampleA::getRHICreateInfo()
@@ -102,87 +134,51 @@ RHIContext::CreateInfo ExampleA::getRHICreateInfo()
 
     info.device.queues = queInfos;
 
+    // Many draws per indirect call for the GPU-driven path
+    info.device.features.multiDrawIndirect = vk::True;
+
     return info;
 }
 
 void ExampleA::createBuffers()
 {
-    auto mvpData = getMVP();
-
-    const VkDeviceSize vertexBufferSize = mVertexData.size() * sizeof(decltype(mVertexData)::value_type);
-    const VkDeviceSize indexBufferSize  = mIndexData.size() * sizeof(decltype(mIndexData)::value_type);
-    const VkDeviceSize uniformBufferSize = sizeof(mvpData) * mSwapChainImages.size();
-
-    const auto vertUsage = vk::BufferUsageFlagBits::eTransferDst | vk::BufferUsageFlagBits::eVertexBuffer;
-    const auto indUsage  = vk::BufferUsageFlagBits::eTransferDst | vk::BufferUsageFlagBits::eIndexBuffer;
-    const auto uplUsage  = vk::BufferUsageFlagBits::eTransferDst | vk::BufferUsageFlagBits::eUniformBuffer;
-
-    VkMemoryPropertyFlags uniformMemFlags = VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT | VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT;
-
-    auto vertexUploadBuffer  = utils::createUploadBuffer(vertexBufferSize);
-    auto indexUploadBuffer   = utils::createUploadBuffer(indexBufferSize);
-    auto uniformUploadBuffer = utils::createUploadBuffer(uniformBufferSize, uplUsage, uniformMemFlags);
-
-    if (*vertexUploadBuffer  == VK_NULL_HANDLE ||
-        *indexUploadBuffer   == VK_NULL_HANDLE ||
-        *uniformUploadBuffer == VK_NULL_HANDLE)
-    {
-        throw std::runtime_error("Failed to create upload buffers.");
-    }
-
-    vertexUploadBuffer.fill(mVertexData);
-    indexUploadBuffer.fill(mIndexData);
-    uniformUploadBuffer.fill((void*)&mvpData, uniformBufferSize);
+    const auto vertexCapacity = std::max<uint32_t>(POLYP_GEOMETRY_VERTICES, static_cast<uint32_t>(mVertexData.size()));
+    const auto indexCapacity  = std::max<uint32_t>(POLYP_GEOMETRY_INDICES, static_cast<uint32_t>(mIndexData.size()));
 
-    mVertexBuffer  = utils::createDeviceBuffer(vertexBufferSize, vertUsage);
-    mIndexBuffer   = utils::createDeviceBuffer(indexBufferSize, indUsage);
-    mUniformBuffer = std::move(uniformUploadBuffer);
+    mGeometry = GeometryHeap(sizeof(Vertex), vertexCapacity, indexCapacity);
 
-    if (*mVertexBuffer  == VK_NULL_HANDLE ||
-        *mIndexBuffer   == VK_NULL_HANDLE ||
-        *mUniformBuffer == VK_NULL_HANDLE)
+    if (*mGeometry.vertexBuffer() == VK_NULL_HANDLE ||
+        *mGeometry.indexBuffer()  == VK_NULL_HANDLE ||
+        *mUniforms.buffer()       == VK_NULL_HANDLE)
     {
         throw std::runtime_error("Failed to create device buffers.");
     }
 
-    std::array<vk::MemoryBarrier, 1> barriers{};
-    barriers[0].srcAccessMask = vk::AccessFlagBits::eTransferWrite;
-    barriers[0].dstAccessMask = vk::AccessFlagBits::eMemoryRead;
-
-    mTransferCmd.reset();
-
-    vk::CommandBufferBeginInfo beginInfo{};
-    beginInfo.flags = vk::CommandBufferUsageFlagBits::eOneTimeSubmit;
-
-    mTransferCmd.begin(beginInfo);
+    mMesh = mGeometry.upload(mVertexData, mIndexData);
+    if (mMesh == GeometryHeap::kInvalidMesh)
+        throw std::runtime_error("Failed to upload geometry.");
 
-    // https://www.khronos.org/registry/vulkan/specs/1.0/html/vkspec.html#synchronization-submission-host-writes
-    // Submission guarantees the host write being complete. No need the following barrier before transfer:
-    // {
-    //   std::array<vk::MemoryBarrier, 1> hostMemBarriers{};
-    //   hostMemBarriers[0].srcAccessMask = vk::AccessFlagBits::eHostWrite;
-    //   hostMemBarriers[0].dstAccessMask = vk::AccessFlagBits::eTransferRead;
-    //   mTransferCmd.pipelineBarrier(vk::PipelineStageFlagBits::eHost, vk::PipelineStageFlagBits::eTransfer, vk::DependencyFlagBits{}, hostMemBarriers, {}, {});
-    // }
-    // When an event is used to synchronize host writes and queue executions (submission happens before the host write), such barrier is necessary.
+    if (mInstanceData.empty())
+        throw std::runtime_error("No instances to draw.");
 
-    vk::BufferCopy copyRegion{ 0, 0, vertexBufferSize };
-    mTransferCmd.copyBuffer(*vertexUploadBuffer, *mVertexBuffer, { copyRegion });
+    const VkDeviceSize instancesSize = sizeof(Instance) * mInstanceData.size();
 
-    copyRegion.size = indexBufferSize;
-    mTransferCmd.copyBuffer(*indexUploadBuffer, *mIndexBuffer, { copyRegion });
+    mInstanceBuffer = utils::createDeviceBuffer(instancesSize, vk::BufferUsageFlagBits::eVertexBuffer | vk::BufferUsageFlagBits::eTransferDst);
+    if (*mInstanceBuffer == VK_NULL_HANDLE)
+        throw std::runtime_error("Failed to create instance buffer.");
 
-    // The barriers are useless because of queue idle and added for demonstration
-    mTransferCmd.pipelineBarrier(vk::PipelineStageFlagBits::eTransfer, vk::PipelineStageFlagBits::eVertexInput, vk::DependencyFlagBits{}, barriers, {}, {});
+    // Bound at record time only
+    mInstanceBuffer.setMovable(true);
+    mInstanceCount = static_cast<uint32_t>(mInstanceData.size());
 
-    mTransferCmd.end();
+    auto& staging = RHIContext::get().staging();
 
-    vk::SubmitInfo submitInfo{};
-    submitInfo.commandBufferCount = 1;
-    submitInfo.pCommandBuffers    = &*mTransferCmd;
+    if (!staging.upload(mInstanceData, mInstanceBuffer))
+        throw std::runtime_error("Failed to upload instances.");
 
-    mQueue.submit(submitInfo);
-    mQueue.waitIdle();
+    // No CPU wait: the first frame submission acquires the buffers and waits for the copies on the GPU
+    // (or just follows them on the same queue if there is no dedicated transfer queue).
+    staging.submit();
 }
 
 void ExampleA::createLayouts()
@@ -234,7 +230,7 @@ void ExampleA::createDS()
     mDescriptorSet = std::move(sets[0]);
 
     vk::DescriptorBufferInfo dsBufferInfo{};
-    dsBufferInfo.buffer = *mUniformBuffer;
+    dsBufferInfo.buffer = *mUniforms.buffer();
     dsBufferInfo.range = static_cast<uint32_t>(sizeof(MVP));
 
     vk::WriteDescriptorSet writeDescriptorSet{};
@@ -311,7 +307,15 @@ void ExampleA::createPipeline()
     vertexInputBinding.stride    = sizeof(Vertex);
     vertexInputBinding.inputRate = vk::VertexInputRate::eVertex;
 
-    std::array<vk::VertexInputAttributeDescription, 2> vertexInputAttributs;
+    // Per-instance transform, a mat4 attribute takes a location per column
+    vk::VertexInputBindingDescription instanceInputBinding{};
+    instanceInputBinding.binding   = 1;
+    instanceInputBinding.stride    = sizeof(Instance);
+    instanceInputBinding.inputRate = vk::VertexInputRate::eInstance;
+
+    std::array<vk::VertexInputBindingDescription, 2> vertexInputBindings{ vertexInputBinding, instanceInputBinding };
+
+    std::array<vk::VertexInputAttributeDescription, 6> vertexInputAttributs;
     vertexInputAttributs[0].binding  = 0;
     vertexInputAttributs[0].location = 0;
     vertexInputAttributs[0].format   = vk::Format::eR32G32B32Sfloat;
@@ -321,10 +325,18 @@ void ExampleA::createPipeline()
     vertexInputAttributs[1].format   = vk::Format::eR32G32B32Sfloat;
     vertexInputAttributs[1].offset   = offsetof(Vertex, color);
 
+    for (uint32_t column = 0; column < 4; ++column)
+    {
+        vertexInputAttributs[2 + column].binding  = 1;
+        vertexInputAttributs[2 + column].location = 2 + column;
+        vertexInputAttributs[2 + column].format   = vk::Format::eR32G32B32A32Sfloat;
+        vertexInputAttributs[2 + column].offset   = offsetof(Instance, model) + sizeof(glm::vec4) * column;
+    }
+
     vk::PipelineVertexInputStateCreateInfo vertexInputStateCreateInfo{};
-    vertexInputStateCreateInfo.vertexBindingDescriptionCount   = 1;
-    vertexInputStateCreateInfo.pVertexBindingDescriptions      = &vertexInputBinding;
-    vertexInputStateCreateInfo.vertexAttributeDescriptionCount = 2;
+    vertexInputStateCreateInfo.vertexBindingDescriptionCount   = static_cast<uint32_t>(vertexInputBindings.size());
+    vertexInputStateCreateInfo.pVertexBindingDescriptions      = vertexInputBindings.data();
+    vertexInputStateCreateInfo.vertexAttributeDescriptionCount = static_cast<uint32_t>(vertexInputAttributs.size());
     vertexInputStateCreateInfo.pVertexAttributeDescriptions    = vertexInputAttributs.data();
 
     // Shaders
@@ -358,30 +370,323 @@ void ExampleA::createPipeline()
             rasterizationStateCreateInfo.polygonMode = vk::PolygonMode::eLine;
     }
 
-    mPipeline = RHIContext::get().device().createGraphicsPipeline(VK_NULL_HANDLE, pipeCreateInfo);
+    RHIContext::get().retire(std::move(mPipeline));
+    mPipeline = RHIContext::get().device().createGraphicsPipeline(RHIContext::get().pipelineCache(), pipeCreateInfo);
+
+    markDirty();
+}
+
+void ExampleA::createCulling()
+{
+    auto& ctx = RHIContext::get();
+
+    // Bounding sphere of the model around its box center
+    glm::vec3 min(std::numeric_limits<float>::max());
+    glm::vec3 max(std::numeric_limits<float>::lowest());
+
+    for (const auto& vertex : mVertexData)
+    {
+        const glm::vec3 position(vertex.position[0], vertex.position[1], vertex.position[2]);
+        min = glm::min(min, position);
+        max = glm::max(max, position);
+    }
+
+    const glm::vec3 center = (min + max) * 0.5f;
+    float           radius = 0.f;
+
+    for (const auto& vertex : mVertexData)
+        radius = std::max(radius, glm::distance(center, glm::vec3(vertex.position[0], vertex.position[1], vertex.position[2])));
+
+    auto shader = loadCullingShader();
+    if (*shader == VK_NULL_HANDLE)
+    {
+        createCPUCulling(center, radius);
+        return;
+    }
+
+    if (!ctx.drawIndirectCount())
+    {
+        POLYPWARN("drawIndirectCount is not supported, instances are culled on the CPU");
+        createCPUCulling(center, radius);
+        return;
+    }
+
+    const auto& mesh      = mGeometry.mesh(mMesh);
+    const auto& instances = mInstanceData;
+
+    std::vector<CullingPass::Object> objects(instances.size());
+
+    for (uint32_t i = 0; i < objects.size(); ++i)
+    {
+        const auto& model = instances[i].model;
+        const float scale = std::max({ glm::length(glm::vec3(model[0])), glm::length(glm::vec3(model[1])), glm::length(glm::vec3(model[2])) });
+
+        objects[i].sphere       = glm::vec4(glm::vec3(model * glm::vec4(center, 1.0f)), radius * scale);
+        objects[i].indexCount   = mesh.indexCount;
+        objects[i].firstIndex   = mesh.firstIndex;
+        objects[i].vertexOffset = mesh.vertexOffset;
+        objects[i].instance     = i;
+    }
+
+    mCulling = CullingPass(shader, objects, ctx.framesInFlight());
+    if (!mCulling)
+    {
+        POLYPWARN("Failed to create the culling pass, instances are culled on the CPU");
+        createCPUCulling(center, radius);
+    }
+}
+
+void ExampleA::createCPUCulling(const glm::vec3& center, float radius)
+{
+    // A single instance is cheaper to draw than to cull
+    if (mInstanceData.size() < 2)
+        return;
+
+    auto& ctx = RHIContext::get();
+
+    mCPUCulling.bounds.clear();
+    mCPUCulling.bounds.reserve(mInstanceData.size());
+
+    for (const auto& instance : mInstanceData)
+    {
+        const auto& model = instance.model;
+        const float scale = std::max({ glm::length(glm::vec3(model[0])), glm::length(glm::vec3(model[1])), glm::length(glm::vec3(model[2])) });
+
+        mCPUCulling.bounds.push(glm::vec3(model * glm::vec4(center, 1.0f)), radius * scale);
+    }
+
+    mCPUCulling.visible.reserve(mInstanceData.size());
+    mCPUCulling.instances.clear();
+    mCPUCulling.commands.clear();
+
+    for (uint32_t i = 0; i < ctx.framesInFlight(); ++i)
+    {
+        auto buffer  = utils::createUploadBuffer(sizeof(Instance) * mInstanceData.size(), vk::BufferUsageFlagBits::eVertexBuffer);
+        auto command = utils::createUploadBuffer(sizeof(vk::DrawIndexedIndirectCommand), vk::BufferUsageFlagBits::eIndirectBuffer);
+        if (*buffer == VK_NULL_HANDLE || buffer.mappedData() == nullptr || *command == VK_NULL_HANDLE || command.mappedData() == nullptr)
+        {
+            POLYPWARN("Failed to create the visible instances buffers, draws are recorded without culling");
+            mCPUCulling.bounds.clear();
+            mCPUCulling.instances.clear();
+            mCPUCulling.commands.clear();
+            return;
+        }
+
+        mCPUCulling.instances.push_back(std::move(buffer));
+        mCPUCulling.commands.push_back(std::move(command));
+    }
+}
+
+void ExampleA::createBaked()
+{
+    auto& ctx          = RHIContext::get();
+    const auto& device = ctx.device();
+
+    mBaked.clear();
+
+    if (!mRenderOptions.recordOnce)
+        return;
+
+    vk::CommandPoolCreateInfo cmdPoolCreateInfo{};
+    cmdPoolCreateInfo.queueFamilyIndex = mQueueFamily;
+    cmdPoolCreateInfo.flags            = vk::CommandPoolCreateFlagBits::eResetCommandBuffer;
+
+    mBakedPool = device.createCommandPool(cmdPoolCreateInfo);
+    if (*mBakedPool == VK_NULL_HANDLE)
+    {
+        POLYPWARN("Failed to create the command pool of the recorded render pass, it is recorded every frame");
+        return;
+    }
+
+    for (uint32_t i = 0; i < ctx.framesInFlight(); ++i)
+    {
+        auto cmd = utils::createCommandBuffer(mBakedPool, vk::CommandBufferLevel::eSecondary);
+        if (*cmd == VK_NULL_HANDLE)
+        {
+            POLYPWARN("Failed to allocate the recorded render pass commands, they are recorded every frame");
+            mBaked.clear();
+            return;
+        }
+
+        mBaked.push_back({ std::move(cmd) });
+    }
+}
+
+Frustum ExampleA::cullingFrustum() const
+{
+    // Object bounds are in the instance space, before the MVP model matrix
+    return Frustum::fromMatrix(mMVP.projectionMatrix * mMVP.viewMatrix * mMVP.modelMatrix);
+}
+
+void ExampleA::recordCulling(const CommandBuffer& cmd)
+{
+    POLYPGPUSCOPE(mGPUProfiler, cmd, "Culling");
+
+    const auto height = RHIContext::get().extent().height;
+
+    const glm::mat4 modelView = mMVP.viewMatrix * mMVP.modelMatrix;
+
+    CullingPass::View view{};
+    view.frustum   = cullingFrustum();
+    view.eye       = glm::vec3(glm::inverse(modelView)[3]);
+    view.scale     = mMVP.projectionMatrix[1][1] * static_cast<float>(height) * 0.5f;
+    view.minPixels = POLYP_CULLING_MIN_PIXELS;
+
+    mCulling.record(cmd, mCurrFrameIndex, view);
+}
+
+void ExampleA::cullInstances()
+{
+    POLYPTRACE("Cull instances");
+
+    const auto count = cull(cullingFrustum(), mCPUCulling.bounds, mCPUCulling.visible);
+
+    // The buffer of the frame index is no longer read by the device
+    const auto& buffer = mCPUCulling.instances[mCurrFrameIndex];
+    auto*       dst    = static_cast<Instance*>(buffer.mappedData());
+
+    for (size_t i = 0; i < count; ++i)
+        dst[i] = mInstanceData[mCPUCulling.visible[i]];
+
+    buffer.flush(0, sizeof(Instance) * count);
+
+    mCPUCulling.count = static_cast<uint32_t>(count);
+
+    // Recorded draws read the count on the GPU
+    const auto& mesh    = mGeometry.mesh(mMesh);
+    const auto& command = mCPUCulling.commands[mCurrFrameIndex];
+
+    *static_cast<vk::DrawIndexedIndirectCommand*>(command.mappedData()) =
+        vk::DrawIndexedIndirectCommand{ mesh.indexCount, mCPUCulling.count, mesh.firstIndex, mesh.vertexOffset, 0 };
+
+    command.flush(0, sizeof(vk::DrawIndexedIndirectCommand));
+}
+
+void ExampleA::markDirty()
+{
+    for (auto& baked : mBaked)
+        baked.dirty = true;
 }
 
 void ExampleA::updateUniformBuffer()
 {
-    const auto mvpData = getMVP();
+    mMVP = getMVP();
 
-    auto pos = mCurrSwImIndex;
+    auto slice = mUniforms.push(mMVP);
+    if (!slice)
+        POLYPFATAL("Failed to allocate uniform data of the frame");
 
-    mUniformBuffer.fill((void*)&mvpData, sizeof(mvpData), sizeof(MVP) * pos);
+    mMVPOffset = slice.offset;
+}
+
+void ExampleA::recordDraws(const CommandBuffer& cmd, uint32_t firstInstance, uint32_t instanceCount) const
+{
+    const auto extent = RHIContext::get().extent();
+
+    const uint32_t width  = extent.width;
+    const uint32_t height = extent.height;
+
+    vk::Viewport viewport{};
+    viewport.height   = (float)height;
+    viewport.width    = (float)width;
+    viewport.minDepth = (float)0.0f;
+    viewport.maxDepth = (float)1.0f;
+
+    // View port transformation flipping (like in OpenGL)
+    // viewport.height = -(float)height;
+    // viewport.width  = (float)width;
+    // viewport.x      = 0;
+    // viewport.y      = height;
+
+    cmd.setViewport(0, viewport);
+
+    vk::Rect2D scissor{};
+    scissor.extent.width  = width;
+    scissor.extent.height = height;
+    scissor.offset.x      = 0;
+    scissor.offset.y      = 0;
+
+    cmd.setScissor(0, scissor);
+
+    const auto& mesh = mGeometry.mesh(mMesh);
+
+    const bool cpuCulling = mCPUCulling.bounds.size() > 0;
+
+    cmd.bindDescriptorSets(vk::PipelineBindPoint::eGraphics, *mPipelineLayout, 0, { *mDescriptorSet }, { mMVPOffset });
+    cmd.bindPipeline(vk::PipelineBindPoint::eGraphics, *mPipeline);
+    mGeometry.bind(cmd);
+    if (cpuCulling)
+        cmd.bindVertexBuffers(1, { *mCPUCulling.instances[mCurrFrameIndex] }, { VkDeviceSize{ 0 } });
+    else
+        cmd.bindVertexBuffers(1, { *mInstanceBuffer }, { VkDeviceSize{ 0 } });
+
+    if (instanceCount == kAllInstances)
+    {
+        if (mCulling)
+            mCulling.draw(cmd, mCurrFrameIndex);
+        else if (cpuCulling)
+            cmd.drawIndexedIndirect(*mCPUCulling.commands[mCurrFrameIndex], 0, 1, sizeof(vk::DrawIndexedIndirectCommand));
+        else
+            cmd.drawIndexed(mesh.indexCount, mInstanceCount, mesh.firstIndex, mesh.vertexOffset, 0);
+    }
+    else
+    {
+        // A draw per object, as a scene of distinct meshes and materials records them
+        for (uint32_t instance = firstInstance; instance < firstInstance + instanceCount; ++instance)
+            cmd.drawIndexed(mesh.indexCount, 1, mesh.firstIndex, mesh.vertexOffset, instance);
+    }
+}
+
+const CommandBuffer& ExampleA::bakedDraws()
+{
+    // Moved buffers have new handles, a compacted geometry heap new buffers and mesh locations
+    const auto generation         = RHIContext::get().defragmenter().generation();
+    const auto geometryGeneration = mGeometry.generation();
+    if (generation != mDefragGeneration || geometryGeneration != mGeometryGeneration)
+    {
+        mDefragGeneration   = generation;
+        mGeometryGeneration = geometryGeneration;
+        markDirty();
+    }
+
+    auto& baked = mBaked[mCurrFrameIndex];
+    if (!baked.dirty && baked.mvpOffset == mMVPOffset)
+        return baked.cmd;
+
+    POLYPTRACE("Record render pass content");
+
+    // The frame's previous submission has completed, nothing else references the commands
+    baked.cmd.reset();
+
+    vk::CommandBufferInheritanceInfo inheritanceInfo{};
+    inheritanceInfo.renderPass = *mRenderPass;
+    inheritanceInfo.subpass    = 0;
+
+    vk::CommandBufferBeginInfo beginInfo{};
+    beginInfo.flags            = vk::CommandBufferUsageFlagBits::eRenderPassContinue;
+    beginInfo.pInheritanceInfo = &inheritanceInfo;
+
+    baked.cmd.begin(beginInfo);
+    recordDraws(baked.cmd, 0, kAllInstances);
+    baked.cmd.end();
+
+    baked.mvpOffset = mMVPOffset;
+    baked.dirty     = false;
+
+    return baked.cmd;
 }
 
 void ExampleA::prepareDrawCommands()
 {
-    CommandBuffer& cmd = mDrawCmds[mCurrSwImIndex];
+    CommandBuffer& cmd = mDrawCmds[mCurrFrameIndex];
 
     vk::CommandBufferBeginInfo beginInfo{};
     beginInfo.flags = vk::CommandBufferUsageFlagBits::eOneTimeSubmit;
 
-    const auto& ctx = RHIContext::get();
-    auto capabilities = ctx.gpu().getSurfaceCapabilitiesKHR(*ctx.surface());
+    const auto extent = RHIContext::get().extent();
 
-    const uint32_t width  = capabilities.currentExtent.width;
-    const uint32_t height = capabilities.currentExtent.height;
+    const uint32_t width  = extent.width;
+    const uint32_t height = extent.height;
 
     vk::ClearValue clearValues[2];
     clearValues[0].color        = vk::ClearColorValue{ 0.4f, 0.4f, 0.4f, 1.0f };
@@ -398,42 +703,48 @@ void ExampleA::prepareDrawCommands()
     renderPassBeginInfo.framebuffer              = *mFrameBuffers[mCurrSwImIndex];
 
     cmd.begin(beginInfo);
-    cmd.beginRenderPass(renderPassBeginInfo, SubpassContents::eInline);
 
-    vk::Viewport viewport{};
-    viewport.height   = (float)height;
-    viewport.width    = (float)width;
-    viewport.minDepth = (float)0.0f;
-    viewport.maxDepth = (float)1.0f;
+    const bool culling    = static_cast<bool>(mCulling);
+    const bool cpuCulling = mCPUCulling.bounds.size() > 0;
+    if (culling)
+        recordCulling(cmd);
+    else if (cpuCulling)
+        cullInstances();
 
-    // View port transformation flipping (like in OpenGL)
-    // viewport.height = -(float)height;
-    // viewport.width  = (float)width;
-    // viewport.x      = 0;
-    // viewport.y      = height;
+    const uint32_t instances = cpuCulling ? mCPUCulling.count : mInstanceCount;
 
-    std::vector<vk::Viewport> viewpors{ viewport };
-    cmd.setViewport(0, viewpors);
+    // Replayed content makes the frame's recording a few calls. Otherwise GPU-driven draws are a single
+    // indirect call and instances a single instanced draw. Per-object draws are recorded every frame,
+    // ranges of them on worker threads, GPU culling already draws an indirect command per object.
+    const bool perObject = mRenderOptions.perObject && !culling;
+    const bool baked     = mRenderOptions.recordOnce && !perObject && !mBaked.empty();
+    const bool parallel  = perObject && mRecorder.threads() > 1 && instances >= 2 * POLYP_RECORD_MIN_ITEMS;
 
-    vk::Rect2D scissor{};
-    scissor.extent.width  = width;
-    scissor.extent.height = height;
-    scissor.offset.x      = 0;
-    scissor.offset.y      = 0;
+    {
+        POLYPGPUSCOPE(mGPUProfiler, cmd, "Render pass");
+        cmd.beginRenderPass(renderPassBeginInfo, baked || parallel ? SubpassContents::eSecondaryCommandBuffers : SubpassContents::eInline);
 
-    std::vector<vk::Rect2D> scissors{ scissor };
-    cmd.setScissor(0, scissors);
+        if (baked)
+        {
+            cmd.executeCommands(*bakedDraws());
+        }
+        else if (parallel)
+        {
+            vk::CommandBufferInheritanceInfo inheritanceInfo{};
+            inheritanceInfo.renderPass  = renderPassBeginInfo.renderPass;
+            inheritanceInfo.subpass     = 0;
+            inheritanceInfo.framebuffer = renderPassBeginInfo.framebuffer;
 
-    std::vector<uint32_t> dynamicOffsets{ static_cast<uint32_t>(sizeof(MVP)) * mCurrSwImIndex };
-    VkDeviceSize verBufferOffset = 0;
+            mRecorder.record(cmd, inheritanceInfo, instances, POLYP_RECORD_MIN_ITEMS,
+                             [this](const CommandBuffer& secondary, uint32_t first, uint32_t count) { recordDraws(secondary, first, count); });
+        }
+        else
+        {
+            recordDraws(cmd, 0, perObject ? instances : kAllInstances);
+        }
 
-    cmd.bindDescriptorSets(vk::PipelineBindPoint::eGraphics, *mPipelineLayout, 0, { *mDescriptorSet }, dynamicOffsets);
-    cmd.bindPipeline(vk::PipelineBindPoint::eGraphics, *mPipeline);
-    cmd.bindIndexBuffer(*mIndexBuffer, 0, vk::IndexType::eUint32);
-    cmd.bindVertexBuffers(0, { *mVertexBuffer }, { verBufferOffset });
-    cmd.bindIndexBuffer(*mIndexBuffer, 0, vk::IndexType::eUint32);
-    cmd.drawIndexed(mIndexData.size(), 1, 0, 0, 1);
-    cmd.endRenderPass();
+        cmd.endRenderPass();
+    }
 
     cmd.end();
 }
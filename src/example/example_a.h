@@ -2,6 +2,10 @@
 
 #include "example_base.h"
 #include "vk_utils.h"
+#include "vk_geometry_heap.h"
+#include "vk_culling.h"
+
+#include <culling.h>
 
 namespace polyp {
 namespace vulkan {
@@ -16,23 +20,41 @@ protected:
         float color[3];
     };
 
+    /// Per-instance vertex data, the model transform occupies locations 2..5 of the vertex shader
+    struct Instance
+    {
+        glm::mat4 model = glm::mat4(1.0f);
+    };
+
     void                     draw()             override;
     bool                     postInit()         override;
     bool                     postResize()       override;
     RHIContext::CreateInfo   getRHICreateInfo() override;
 
+    /// Writes the frame's MVP into the uniform allocator, must be called before the draw commands are recorded
     void                     updateUniformBuffer();
 
+    /// Invalidates the recorded render pass content, to be called on any change of what it binds or draws
+    void                     markDirty();
+
     using ShadersData = std::tuple<ShaderModule/*vert*/, ShaderModule/*frag*/>;
     using ModelsData  = std::tuple<std::vector<Vertex>/*vertices*/, std::vector<uint32_t>/*indexes*/>;
 
     virtual ShadersData      loadShaders() = 0;
     virtual ModelsData       loadModel()   = 0;
 
-    CommandBuffer            mTransferCmd    = { VK_NULL_HANDLE };
-    Buffer                   mVertexBuffer   = { VK_NULL_HANDLE };
-    Buffer                   mIndexBuffer    = { VK_NULL_HANDLE };
-    Buffer                   mUniformBuffer  = { VK_NULL_HANDLE };
+    /// The model is drawn once per instance with a single instanced draw, one untransformed instance by default
+    virtual std::vector<Instance> loadInstances() { return { Instance{} }; }
+
+    /// Culling compute shader of CullingPass. With it (and drawIndirectCount support) the draws are
+    /// GPU-driven: every instance is an object culled and drawn by its own indirect command.
+    /// Otherwise several instances are culled on the CPU and the visible ones are drawn instanced.
+    virtual ShaderModule     loadCullingShader() { return { nullptr }; }
+
+    GeometryHeap             mGeometry       = { nullptr };
+    GeometryHeap::MeshId     mMesh           = GeometryHeap::kInvalidMesh;
+    Buffer                   mInstanceBuffer = { VK_NULL_HANDLE };
+    uint32_t                 mInstanceCount  = 0;
     DescriptorSetLayout      mDSLayout       = { VK_NULL_HANDLE };
     PipelineLayout           mPipelineLayout = { VK_NULL_HANDLE };
     DescriptorPool           mDesriptorPool  = { VK_NULL_HANDLE };
@@ -42,6 +64,10 @@ protected:
     std::vector<Framebuffer> mFrameBuffers   = {};
     std::vector<Vertex>      mVertexData     = {};
     std::vector<uint32_t>    mIndexData      = {};
+    std::vector<Instance>    mInstanceData   = {};
+    uint32_t                 mMVPOffset      = 0; // dynamic offset of the frame's MVP
+    MVP                      mMVP            = {}; // the frame's MVP
+    uint64_t                 mCullingFrames  = 0;
 
     struct
     {
@@ -51,14 +77,61 @@ protected:
 
     struct
     {
-        bool solid = true;
+        bool solid      = true;
+        bool recordOnce = POLYP_RECORD_ONCE;     // replay the render pass content until it is dirty
+        bool perObject  = POLYP_DRAW_PER_OBJECT; // a drawIndexed per instance, recorded in parallel every frame
     } mRenderOptions;
 
+    CullingPass              mCulling        = { nullptr };
+
+    struct
+    {
+        BoundsSoA             bounds;    // of mInstanceData, empty if the CPU path is off
+        std::vector<uint32_t> visible;
+        std::vector<Buffer>   instances; // visible instances per frame in flight
+        std::vector<Buffer>   commands;  // per frame in flight, the indirect draw of the visible instances
+        uint32_t              count = 0; // of the current frame
+    } mCPUCulling;
+
 private:
+    /// Draws every instance of the frame, the count is read on the GPU when the frame culls them
+    static constexpr uint32_t kAllInstances = UINT32_MAX;
+
+    /// Render pass content recorded once per frame in flight and replayed until it is dirty
+    struct Baked
+    {
+        CommandBuffer cmd       = { VK_NULL_HANDLE };
+        uint32_t      mvpOffset = 0;    // the dynamic offset is recorded into the commands
+        bool          dirty     = true;
+    };
+
+    struct
+    {
+        Extent2D extent = {};
+        Format   format = Format::eUndefined;
+    } mAttachmentsInfo; // what the current attachments and render pass were built for
+
+    CommandPool              mBakedPool          = { VK_NULL_HANDLE };
+    std::vector<Baked>       mBaked              = {};
+    uint64_t                 mDefragGeneration   = 0;
+    uint64_t                 mGeometryGeneration = 0;
+
     void createBuffers();
     void createLayouts();
     void createDS();
     void createPipeline();
+    void createCulling();
+    void createCPUCulling(const glm::vec3& center, float radius);
+    /// Frustum of the frame's MVP, shared by the GPU and the CPU culling
+    Frustum cullingFrustum() const;
+    void recordCulling(const CommandBuffer& cmd);
+    void createBaked();
+    void cullInstances();
+    /// Records the render pass content: every instance of the frame with kAllInstances, otherwise a draw per
+    /// instance of the range. Thread-safe for the parallel recording of per-object ranges.
+    void recordDraws(const CommandBuffer& cmd, uint32_t firstInstance, uint32_t instanceCount) const;
+    /// The frame's baked render pass content, recorded again if it is dirty
+    const CommandBuffer& bakedDraws();
     void prepareDrawCommands();
 };
 
@@ -1,6 +1,8 @@
 #include "example_base.h"
 #include "vk_utils.h"
 
+#include <fstream>
+
 namespace polyp {
 namespace vulkan {
 namespace example {
@@ -11,11 +13,61 @@ void ExampleBase::onRender()
     if (mPauseDrawing)
         return;
 
-    acquireNextSwapChainImage();
-    waitForFence();
-    draw();
-    submit();
-    present();
+    POLYPTRACE("Render");
+
+    // Pools and caches fill during the first frames, after a resize and while buffers are defragmented,
+    // the frames in between must not touch the heap
+    POLYPALLOCCHECK("Frame", mSteadyFrames > POLYP_ALLOC_CHECK_WARMUP_FRAMES && !mSwapchainDirty);
+
+    // Resize events only mark the swapchain, so a window drag recreates it once per frame at most
+    if (mSwapchainDirty && !recreateSwapchain())
+        return;
+
+    {
+        POLYPTRACE("Wait for frame");
+        waitForFrame();
+    }
+
+    RHIContext::get().collect();
+    RHIContext::get().defragmenter().update();
+
+    if (RHIContext::get().defragmenter().running())
+        mSteadyFrames = 0;
+
+    // The frame's command buffers are no longer in use, release them all at once
+    mCmdPools[mCurrFrameIndex].reset();
+    mRecorder.beginFrame(mCurrFrameIndex);
+
+    mGPUProfiler.beginFrame(mCurrFrameIndex);
+    mUniforms.beginFrame(mCurrFrameIndex);
+
+    // Pipelined mode: the frame draws the newest camera the simulation thread has published
+    if (mSnapshots.update())
+        mCamera = mSnapshots.front();
+
+    {
+        POLYPTRACE("Acquire");
+        if (!acquireNextSwapChainImage())
+            return;
+    }
+    {
+        POLYPTRACE("Draw");
+        draw();
+    }
+    {
+        POLYPTRACE("Submit");
+        submit();
+    }
+    {
+        POLYPTRACE("Present");
+        present();
+    }
+
+    mCurrFrameIndex = (mCurrFrameIndex + 1) % mDrawCmds.size();
+    ++mSteadyFrames;
+
+    if (POLYP_MEMORY_REPORT_FRAMES > 0 && ++mFrameNumber % POLYP_MEMORY_REPORT_FRAMES == 0)
+        reportMemory();
 }
 
 bool ExampleBase::onInit(const WindowInitializedEventArgs& args)
@@ -28,6 +80,9 @@ bool ExampleBase::onInit(const WindowInitializedEventArgs& args)
     if (mContextInfo.win.handle == NULL)
         mContextInfo.win.handle   = args.windowHandle;
 
+    if (mContextInfo.swapchain.extent.width == 0 || mContextInfo.swapchain.extent.height == 0)
+        mContextInfo.swapchain.extent = Extent2D{ args.width, args.height };
+
     auto& ctx = RHIContext::get();
 
     ctx.init(mContextInfo);
@@ -42,9 +97,10 @@ bool ExampleBase::onInit(const WindowInitializedEventArgs& args)
 
     const auto& device = ctx.device();
 
-    auto familyIdx = ctx.queueFamily(mContextInfo.device.queues[0].flags);
+    auto familyIdx = ctx.graphicsFamily();
 
-    mQueue = ctx.device().getQueue(familyIdx, 0);
+    mQueue       = ctx.device().getQueue(familyIdx, 0);
+    mQueueFamily = familyIdx;
     if (*mQueue == VK_NULL_HANDLE)
         POLYPFATAL("Failed to create vulkan graphics queue.");
 
@@ -52,31 +108,36 @@ bool ExampleBase::onInit(const WindowInitializedEventArgs& args)
 
     vk::CommandPoolCreateInfo cmdPoolCreateInfo{};
     cmdPoolCreateInfo.queueFamilyIndex = familyIdx;
-    cmdPoolCreateInfo.flags            = vk::CommandPoolCreateFlagBits::eResetCommandBuffer;
+    cmdPoolCreateInfo.flags            = vk::CommandPoolCreateFlagBits::eTransient;
 
-    mCmdPool = ctx.device().createCommandPool(cmdPoolCreateInfo);
-    if (*mCmdPool == VK_NULL_HANDLE)
-        POLYPFATAL("Failed to create command pool.");
+    mCmdPools.clear();
+    for (uint32_t i = 0; i < ctx.framesInFlight(); ++i)
+    {
+        auto pool = ctx.device().createCommandPool(cmdPoolCreateInfo);
+        if (*pool == VK_NULL_HANDLE)
+            POLYPFATAL("Failed to create command pool.");
 
-    mAqImageFence = utils::createFence();
-    if (*mAqImageFence == VK_NULL_HANDLE)
-        POLYPFATAL("Failed to create fence.");
+        mCmdPools.push_back(std::move(pool));
+    }
 
-    WindowResizeEventArgs resizeArgs
-    {
-        .mode = WindowResizeMode::Restored
-    };
+    mGPUProfiler = GPUProfiler(ctx.framesInFlight(), familyIdx);
+    mUniforms    = UniformAllocator(POLYP_UNIFORM_FRAME_SIZE, ctx.framesInFlight());
+    mRecorder    = ParallelRecorder(familyIdx, std::max(POLYP_RECORD_THREADS, 1), ctx.framesInFlight());
 
-    onResize(resizeArgs);
+    if (!recreateSwapchain())
+        POLYPFATAL("Failed to create swapchain resources.");
 
     createDrawCmds();
 
-    if (mDrawCmds.size() != mSwapChainImages.size())
-        POLYPFATAL("Failed to create command buffers and fences.");
+    if (mDrawCmds.empty() || mDrawCmds.size() != ctx.framesInFlight())
+        POLYPFATAL("Failed to create command buffers, fences and semaphores.");
 
     if (!postInit())
         POLYPFATAL("Post initialization failed.");
 
+    if (POLYP_PIPELINED)
+        startSimulation();
+
     return true;
 }
 
@@ -88,23 +149,37 @@ bool ExampleBase::onResize(const WindowResizeEventArgs& args)
         return true;
     }
 
-    mPauseDrawing = false;
+    mPauseDrawing   = false;
+    mSwapchainDirty = true;
+
+    return true;
+}
+
+bool ExampleBase::recreateSwapchain()
+{
+    POLYPTRACE("Recreate swapchain");
 
-    const auto& device    = RHIContext::get().device();
-    const auto& swapchain = RHIContext::get().swapchain();
+    auto& ctx          = RHIContext::get();
+    const auto& device = ctx.device();
+
+    // No device wait: the old swapchain and everything built on it are retired until in-flight frames complete
+    if (!ctx.onResize())
+        return false;
 
-    device.waitIdle();
-    RHIContext::get().onResize();
+    mSwapchainDirty = false;
+    mSteadyFrames   = 0;
 
-    mSwapChainImages = swapchain.getImages();
+    mSwapChainImages = ctx.images();
 
+    ctx.retire(std::move(mSwapChainViews));
+    ctx.retire(std::move(mRenderSemaphores));
     mSwapChainViews.clear();
-    mSemaphores.clear();
+    mRenderSemaphores.clear();
 
     for (auto i = 0; i < mSwapChainImages.size(); ++i)
     {
         vk::ImageViewCreateInfo viewCreateInfo{};
-        viewCreateInfo.format     = swapchain.getImageFormatPLP();
+        viewCreateInfo.format     = ctx.colorFormat();
         viewCreateInfo.components =
         {
             VK_COMPONENT_SWIZZLE_R,
@@ -129,13 +204,31 @@ bool ExampleBase::onResize(const WindowResizeEventArgs& args)
         if (*semaphore == VK_NULL_HANDLE)
             POLYPFATAL("Failed to create semaphore.");
 
-        mSemaphores.push_back(std::move(semaphore));
+        mRenderSemaphores.push_back(std::move(semaphore));
     }
 
     return postResize();
 }
 
+ExampleBase::~ExampleBase()
+{
+    stopSimulation();
+}
+
 void ExampleBase::onMouseClick(const MouseClickEventArgs& args)
+{
+    if (mSimThread.joinable())
+    {
+        SimInput input{};
+        input.click = args;
+        post(input);
+        return;
+    }
+
+    processMouseClick(args);
+}
+
+void ExampleBase::processMouseClick(const MouseClickEventArgs& args)
 {
     if (args.button == MouseButton::Left && args.action == MouseActioin::Click)
     {
@@ -150,27 +243,43 @@ void ExampleBase::onMouseClick(const MouseClickEventArgs& args)
 
 void ExampleBase::onMovement(const MovementEventArgs& args)
 {
-    auto deltaTime = (1 / mFPSCounter.curfps());
+    // Called on the render thread, so the frame time is read here in both modes
+    const float deltaTime = 1 / mFPSCounter.curfps();
+
+    if (mSimThread.joinable())
+    {
+        SimInput input{};
+        input.movement  = true;
+        input.move      = args;
+        input.deltaTime = deltaTime;
+        post(input);
+        return;
+    }
+
+    processMovement(mCamera, args, deltaTime);
+}
 
+void ExampleBase::processMovement(Camera& camera, const MovementEventArgs& args, float deltaTime)
+{
     if (args.HasReset())
         POLYPTODO("Reset camera");
 
     if (args.HasMotion())
     {
         if (args.move.ahead)
-            mCamera.processKeyboard(Camera::Direction::Forward, deltaTime);
+            camera.processKeyboard(Camera::Direction::Forward, deltaTime);
         else if (args.move.back)
-            mCamera.processKeyboard(Camera::Direction::Backward, deltaTime);
+            camera.processKeyboard(Camera::Direction::Backward, deltaTime);
 
         if (args.move.left)
-            mCamera.processKeyboard(Camera::Direction::Left, deltaTime);
+            camera.processKeyboard(Camera::Direction::Left, deltaTime);
         else if (args.move.righ)
-            mCamera.processKeyboard(Camera::Direction::Right, deltaTime);
+            camera.processKeyboard(Camera::Direction::Right, deltaTime);
 
         if (args.move.up)
-            mCamera.processKeyboard(Camera::Direction::Up, deltaTime);
+            camera.processKeyboard(Camera::Direction::Up, deltaTime);
         else if (args.move.down)
-            mCamera.processKeyboard(Camera::Direction::Down, deltaTime);
+            camera.processKeyboard(Camera::Direction::Down, deltaTime);
     }
 
     if (args.HasMouse() && mMouseMoving)
@@ -188,13 +297,98 @@ void ExampleBase::onMovement(const MovementEventArgs& args)
         mLastXMousePos = args.mouse.x;
         mLastYMousePos = args.mouse.y;
 
-        mCamera.procesMouse(xoffset, yoffset, deltaTime);
+        camera.procesMouse(xoffset, yoffset, deltaTime);
+    }
+}
+
+void ExampleBase::startSimulation()
+{
+    // The simulation thread owns its camera from now on, the render thread draws the copies it publishes
+    mSimStop.store(false, std::memory_order_relaxed);
+    mSimThread = std::thread(&ExampleBase::simulate, this, mCamera);
+}
+
+void ExampleBase::stopSimulation()
+{
+    if (!mSimThread.joinable())
+        return;
+
+    mSimStop.store(true, std::memory_order_release);
+    mSimSignal.fetch_add(1, std::memory_order_release);
+    mSimSignal.notify_all();
+
+    mSimThread.join();
+}
+
+void ExampleBase::post(const SimInput& input)
+{
+    if (!mSimInputs.push(input))
+    {
+        POLYPWARN("Simulation input queue is full, the input is dropped");
+        return;
+    }
+
+    mSimSignal.fetch_add(1, std::memory_order_release);
+    mSimSignal.notify_one();
+}
+
+void ExampleBase::simulate(Camera camera)
+{
+    uint64_t signal = 0;
+
+    while (true)
+    {
+        // Runs once per frame of input, while the render thread records the frame before
+        mSimSignal.wait(signal, std::memory_order_acquire);
+        signal = mSimSignal.load(std::memory_order_acquire);
+
+        if (mSimStop.load(std::memory_order_acquire))
+            break;
+
+        POLYPTRACE("Simulate");
+
+        SimInput input;
+        while (mSimInputs.pop(input))
+        {
+            if (input.movement)
+                processMovement(camera, input.move, input.deltaTime);
+            else
+                processMouseClick(input.click);
+        }
+
+        mSnapshots.back() = camera;
+        mSnapshots.publish();
     }
 }
 
 void ExampleBase::onShoutDown()
 {
+    stopSimulation();
+
     RHIContext::get().device().waitIdle();
+
+    if (mGPUProfiler.enabled())
+        POLYPINFO("GPU time: %s", mGPUProfiler.toString().c_str());
+
+    reportMemory();
+
+#ifdef POLYP_MEMORY_STATS_FILE
+    std::ofstream os(POLYP_MEMORY_STATS_FILE);
+    os << RHIContext::get().device().buildStatsStringPLP(true);
+#endif // POLYP_MEMORY_STATS_FILE
+}
+
+void ExampleBase::reportMemory() const
+{
+    const auto& device = RHIContext::get().device();
+
+    POLYPINFO("GPU memory: %s", device.getMemoryReportPLP().c_str());
+
+    for (const auto& heap : device.getHeapBudgetsPLP())
+    {
+        if (heap.budget > 0 && heap.usage > heap.budget / 10 * 9)
+            POLYPWARN("GPU memory heap usage is over 90%% of the budget, the driver may start paging");
+    }
 }
 
 ExampleBase::MVP ExampleBase::getMVP()
@@ -205,100 +399,164 @@ ExampleBase::MVP ExampleBase::getMVP()
 
     output.viewMatrix = mCamera.view();
 
-    auto& ctx         = vulkan::RHIContext::get();
-    auto capabilities = ctx.gpu().getSurfaceCapabilitiesKHR(*ctx.surface());
+    const auto extent = vulkan::RHIContext::get().extent();
 
-    const auto width  = capabilities.currentExtent.width;
-    const auto height = capabilities.currentExtent.height;
+    const auto width  = extent.width;
+    const auto height = extent.height;
 
-    output.projectionMatrix = glm::perspective(glm::radians(45.0f), (float)width / (float)height, 0.1f, 100.0f);
+    mCamera.perspective(glm::radians(45.0f), (float)width / (float)height, 0.1f, 100.0f);
+    output.projectionMatrix = mCamera.projection();
 
     return output;
 }
 
-void ExampleBase::acquireNextSwapChainImage()
+bool ExampleBase::acquireNextSwapChainImage()
 {
-    const auto& swapchain = RHIContext::get().swapchain();
+    // No host wait here: the submit waits for the acquire semaphore on the GPU
+    auto [res, imIdx] = RHIContext::get().acquireNextImage(constants::kFenceTimeout, *mAcquireSemaphores[mCurrFrameIndex], VK_NULL_HANDLE);
 
-    auto [res, imIdx] = swapchain.acquireNextImage(constants::kFenceTimeout, VK_NULL_HANDLE, *mAqImageFence);
-    if (res !=  vk::Result::eSuccess )
+    switch (res)
+    {
+    case vk::Result::eSuccess:
+        break;
+    case vk::Result::eSuboptimalKHR: // the image is acquired and can be rendered, recreate on the next frame
+        mSwapchainDirty = true;
+        break;
+    case vk::Result::eErrorOutOfDateKHR:
+        mSwapchainDirty = true;
+        return false;
+    case vk::Result::eTimeout:
+    case vk::Result::eNotReady:
+        POLYPWARN("Swapchain image is not available in time, the frame is skipped");
+        return false;
+    default:
         POLYPFATAL("Failed acquire the next swapchain image with result %s", vk::to_string(res).c_str());
-
-    res = RHIContext::get().device().waitForFences(*mAqImageFence, VK_TRUE, constants::kFenceTimeout);
-    if (res != vk::Result::eSuccess)
-        POLYPFATAL("Failed wait for the next swapchain image with result %s", vk::to_string(res).c_str());
-
-    res = mAqImageFence.getStatus();
-    if (res != vk::Result::eSuccess)
-        POLYPFATAL("Unexpected VkFence wait result %s", vk::to_string(res).c_str());
-
-    RHIContext::get().device().resetFences(*mAqImageFence);
+        return false;
+    }
 
     mCurrSwImIndex = imIdx;
+
+    return true;
 }
 
 void ExampleBase::createDrawCmds()
 {
-    const auto size = mSwapChainImages.size();
+    const auto size = RHIContext::get().framesInFlight();
+    const auto& device = RHIContext::get().device();
 
     mDrawCmds.clear();
-    mDrawFences.clear();
+    mFrameValues.clear();
+    mAcquireSemaphores.clear();
+    mPrologueCmds.clear();
 
     for (size_t i = 0; i < size; ++i)
     {
-        auto cmd = utils::createCommandBuffer(mCmdPool, vk::CommandBufferLevel::ePrimary);
+        auto cmd = utils::createCommandBuffer(mCmdPools[i], vk::CommandBufferLevel::ePrimary);
         if (*cmd == VK_NULL_HANDLE)
             continue;
 
-        auto fence = utils::createFence(true);
-        if (*fence == VK_NULL_HANDLE)
+        auto prologueCmd = utils::createCommandBuffer(mCmdPools[i], vk::CommandBufferLevel::ePrimary);
+        if (*prologueCmd == VK_NULL_HANDLE)
+            continue;
+
+        auto semaphore = device.createSemaphore(vk::SemaphoreCreateInfo{});
+        if (*semaphore == VK_NULL_HANDLE)
             continue;
 
         mDrawCmds.push_back(std::move(cmd));
-        mDrawFences.push_back(std::move(fence));
+        mPrologueCmds.push_back(std::move(prologueCmd));
+        mFrameValues.push_back(0);
+        mAcquireSemaphores.push_back(std::move(semaphore));
     }
 }
 
 void ExampleBase::submit()
 {
+    auto& ctx      = RHIContext::get();
+    auto& timeline = ctx.timeline();
+    auto& staging  = ctx.staging();
+    auto& defrag   = ctx.defragmenter();
+
+    std::array<vk::Semaphore, 2>          waitSemaphores = { *mAcquireSemaphores[mCurrFrameIndex], *staging.timeline() };
+    std::array<uint64_t, 2>               waitValues     = { 0, 0 };
+    std::array<vk::PipelineStageFlags, 2> waitStages     = { vk::PipelineStageFlagBits::eColorAttachmentOutput,
+                                                             vk::PipelineStageFlagBits::eAllCommands };
+
+    std::array<vk::CommandBuffer, 2> cmds = { *mDrawCmds[mCurrFrameIndex] };
+    uint32_t                         cmdsCount = 1;
+
+    // Uploads done on the transfer queue: take the ownership before the frame and wait for the copies on the GPU.
+    // Defragmentation copies go before the frame as well, the frame still draws from the old locations.
+    if (staging.hasAcquires() || defrag.hasPass())
+    {
+        const auto& prologueCmd = mPrologueCmds[mCurrFrameIndex];
+
+        vk::CommandBufferBeginInfo beginInfo{};
+        beginInfo.flags = vk::CommandBufferUsageFlagBits::eOneTimeSubmit;
+
+        prologueCmd.begin(beginInfo);
+        if (staging.hasAcquires())
+            waitValues[1] = staging.acquire(prologueCmd);
+        defrag.record(prologueCmd);
+        prologueCmd.end();
+
+        cmds      = { *prologueCmd, *mDrawCmds[mCurrFrameIndex] };
+        cmdsCount = 2;
+    }
+
+    mUniforms.flush();
+
+    mFrameValues[mCurrFrameIndex] = timeline.next();
+
+    // The binary render semaphore ignores its value
+    std::array<vk::Semaphore, 2> signalSemaphores = { *mRenderSemaphores[mCurrSwImIndex], *timeline };
+    std::array<uint64_t, 2>      signalValues     = { 0, mFrameValues[mCurrFrameIndex] };
+
+    const uint32_t waitCount = waitValues[1] != 0 ? 2 : 1;
+
+    vk::TimelineSemaphoreSubmitInfo timelineInfo{};
+    timelineInfo.waitSemaphoreValueCount   = waitCount;
+    timelineInfo.pWaitSemaphoreValues      = waitValues.data();
+    timelineInfo.signalSemaphoreValueCount = static_cast<uint32_t>(signalValues.size());
+    timelineInfo.pSignalSemaphoreValues    = signalValues.data();
+
     vk::SubmitInfo submitInfo{};
-    submitInfo.commandBufferCount   = 1;
-    submitInfo.pCommandBuffers      = &*mDrawCmds[mCurrSwImIndex];
-    submitInfo.signalSemaphoreCount = 1;
-    submitInfo.pSignalSemaphores    = &*mSemaphores[mCurrSwImIndex];
-    mQueue.submit(submitInfo, *mDrawFences[mCurrSwImIndex]);
+    submitInfo.pNext                = &timelineInfo;
+    submitInfo.waitSemaphoreCount   = waitCount;
+    submitInfo.pWaitSemaphores      = waitSemaphores.data();
+    submitInfo.pWaitDstStageMask    = waitStages.data();
+    submitInfo.commandBufferCount   = cmdsCount;
+    submitInfo.pCommandBuffers      = cmds.data();
+    submitInfo.signalSemaphoreCount = static_cast<uint32_t>(signalSemaphores.size());
+    submitInfo.pSignalSemaphores    = signalSemaphores.data();
+    mQueue.submit(submitInfo);
 }
 
 void ExampleBase::present()
 {
     vk::PresentInfoKHR presentInfo{};
     presentInfo.waitSemaphoreCount = 1;
-    presentInfo.pWaitSemaphores    = &*mSemaphores[mCurrSwImIndex];
+    presentInfo.pWaitSemaphores    = &*mRenderSemaphores[mCurrSwImIndex];
     presentInfo.swapchainCount     = 1;
     presentInfo.pSwapchains        = &*RHIContext::get().swapchain();
     presentInfo.pImageIndices      = &mCurrSwImIndex;
 
-    auto res = mQueue.presentKHR(presentInfo);
+    auto res = RHIContext::get().present(mQueue, presentInfo);
 
     mFPSCounter.onPresent();
 
-    if (res != vk::Result::eSuccess)
+    if (res == vk::Result::eSuboptimalKHR || res == vk::Result::eErrorOutOfDateKHR)
+        mSwapchainDirty = true;
+    else if (res != vk::Result::eSuccess)
         POLYPFATAL("Present failed with result %s", vk::to_string(res).c_str());
 }
 
-void ExampleBase::waitForFence()
+void ExampleBase::waitForFrame()
 {
-    const auto& ctx = RHIContext::get();
-
-    auto res = ctx.device().waitForFences(*mDrawFences[mCurrSwImIndex], VK_TRUE, constants::kFenceTimeout);
-    if (res != vk::Result::eSuccess)
-        POLYPFATAL("Unexpected VkFence wait result %s", vk::to_string(res).c_str());
-
-    res = mDrawFences[mCurrSwImIndex].getStatus();
-    if (res != vk::Result::eSuccess)
-        POLYPFATAL("Unexpected VkFence wait result %s", vk::to_string(res).c_str());
+    const auto& timeline = RHIContext::get().timeline();
 
-    vulkan::RHIContext::get().device().resetFences(*mDrawFences[mCurrSwImIndex]);
+    if (!timeline.wait(mFrameValues[mCurrFrameIndex]))
+        POLYPFATAL("Frame %llu has not been completed in time", static_cast<unsigned long long>(mFrameValues[mCurrFrameIndex]));
 }
 
 } // example
@@ -1,9 +1,14 @@
 #pragma once
 
 #include "vk_context.h"
+#include "vk_profiler.h"
+#include "vk_uniform_allocator.h"
+#include "vk_recorder.h"
 #include "application.h"
 #include "fps_counter.h"
 #include "camera.h"
+#include "spsc_queue.h"
+#include "triple_buffer.h"
 
 #define RUN_APP_EXAMPLE(ClassName)                                                                             \
 std::string title{ POLYP_WIN_TITLE };                                                                  \
@@ -42,13 +47,14 @@ class ExampleBase
 {
 public:
     ExampleBase() :
-       mCamera{ constants::kCameraInitPos, constants::kCameraWorldUp, constants::kCameraInitLookAt }
+       mCamera{ constants::kCameraInitPos, constants::kCameraWorldUp, constants::kCameraInitLookAt },
+       mSnapshots{ mCamera }
     {
         mCamera.speed(constants::kMoveSpeed);
         mCamera.sensitivity(constants::kSensitivity);
     }
 
-    virtual ~ExampleBase() = default;
+    virtual ~ExampleBase();
 
     void onRender();
     void onShoutDown();
@@ -73,29 +79,61 @@ protected:
     virtual RHIContext::CreateInfo getRHICreateInfo() = 0;
 
     Queue                      mQueue           = { VK_NULL_HANDLE };
-    CommandPool                mCmdPool         = { VK_NULL_HANDLE };
-    std::vector<CommandBuffer> mDrawCmds        = {};
-    std::vector<Fence>         mDrawFences      = {};
+    uint32_t                   mQueueFamily     = 0;
+    std::vector<CommandPool>   mCmdPools        = {}; // per frame in flight, reset when the frame begins
+    std::vector<CommandBuffer> mDrawCmds        = {}; // per frame in flight
+    std::vector<uint64_t>      mFrameValues     = {}; // per frame in flight, timeline value signaled by the frame
+    uint32_t                   mCurrFrameIndex  = {};
     uint32_t                   mCurrSwImIndex   = {};
     std::vector<vk::Image>     mSwapChainImages = {};
     std::vector<ImageView>     mSwapChainViews  = {};
+    GPUProfiler                mGPUProfiler     = { nullptr };
+    UniformAllocator           mUniforms        = { nullptr }; // per-frame constants
+    ParallelRecorder           mRecorder        = { nullptr }; // secondary command buffers of the render pass
     FPSCounter                 mFPSCounter;
-    Camera                     mCamera;
+    Camera                     mCamera;          // drawn camera, in pipelined mode the latest simulation snapshot
 
 private:
+    /// Input the render thread hands to the simulation thread in pipelined mode
+    struct SimInput
+    {
+        bool                movement  = false; // move is set, click otherwise
+        MovementEventArgs   move      = {};
+        MouseClickEventArgs click     = {};
+        float               deltaTime = 0;     // of the frame that sampled the movement
+    };
+
+    void processMovement(Camera& camera, const MovementEventArgs& args, float deltaTime);
+    void processMouseClick(const MouseClickEventArgs& args);
+    void startSimulation();
+    void stopSimulation();
+    void post(const SimInput& input);
+    void simulate(Camera camera);
     void submit();
     void present();
-    void waitForFence();
+    void waitForFrame();
     void createDrawCmds();
-    void acquireNextSwapChainImage();
+    bool recreateSwapchain();
+    bool acquireNextSwapChainImage();
+    void reportMemory() const;
+
+    std::vector<Semaphore>     mAcquireSemaphores = {}; // per frame in flight
+    std::vector<Semaphore>     mRenderSemaphores  = {}; // per swapchain image
+    std::vector<CommandBuffer> mPrologueCmds      = {}; // per frame in flight, upload acquires and defragmentation copies
+    RHIContext::CreateInfo     mContextInfo       = {};
+    uint64_t                   mFrameNumber       = 0;
+    uint64_t                   mSteadyFrames      = 0; // frames since the last resize or defragmentation step
+    float                      mLastXMousePos     = 0.0;
+    float                      mLastYMousePos     = 0.0;
+    bool                       mPauseDrawing      = false;
+    bool                       mSwapchainDirty    = false;
+    bool                       mMouseMoving       = false;
 
-    Fence                  mAqImageFence  = { VK_NULL_HANDLE };
-    std::vector<Semaphore> mSemaphores    = {};
-    RHIContext::CreateInfo mContextInfo   = {};
-    float                  mLastXMousePos = 0.0;
-    float                  mLastYMousePos = 0.0;
-    bool                   mPauseDrawing  = false;
-    bool                   mMouseMoving   = false;
+    SPSCQueue<SimInput, POLYP_INPUT_QUEUE_SIZE> mSimInputs;
+    TripleBuffer<Camera>       mSnapshots;              // cameras published by the simulation thread
+    std::thread                mSimThread;
+    std::atomic<uint64_t>      mSimSignal         = 0;  // bumped per queued input and on stop
+    std::atomic<bool>          mSimStop           = false;
 };
 
 } // example
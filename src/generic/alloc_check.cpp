@@ -0,0 +1,135 @@
+#include "alloc_check.h"
+
+#ifdef POLYP_ENABLE_ALLOC_CHECK
+
+#include <global.h>
+
+#include <atomic>
+#include <cstdlib>
+#include <new>
+
+#ifdef _WIN32
+    #include <malloc.h>
+#endif
+
+namespace polyp {
+namespace alloc {
+
+namespace {
+
+std::atomic<uint64_t> gAllocations = 0;
+thread_local bool     tTracked     = false;
+
+void* allocate(std::size_t size)
+{
+    if (tTracked)
+        gAllocations.fetch_add(1, std::memory_order_relaxed);
+    return std::malloc(size == 0 ? 1 : size);
+}
+
+void* allocate(std::size_t size, std::align_val_t align)
+{
+    if (tTracked)
+        gAllocations.fetch_add(1, std::memory_order_relaxed);
+
+    const auto alignment = static_cast<std::size_t>(align);
+#ifdef _WIN32
+    return _aligned_malloc(size == 0 ? 1 : size, alignment);
+#else
+    // aligned_alloc wants the size to be a multiple of the alignment
+    return std::aligned_alloc(alignment, (size + alignment - 1) / alignment * alignment);
+#endif
+}
+
+void release(void* ptr, std::align_val_t) noexcept
+{
+#ifdef _WIN32
+    _aligned_free(ptr);
+#else
+    std::free(ptr);
+#endif
+}
+
+} // namespace
+
+uint64_t count() noexcept
+{
+    return gAllocations.load(std::memory_order_relaxed);
+}
+
+void track() noexcept
+{
+    tTracked = true;
+}
+
+void fail(const char* name, uint64_t allocations)
+{
+    POLYPFATAL("%s allocated on the heap %llu times", name, static_cast<unsigned long long>(allocations));
+}
+
+} // namespace alloc
+} // namespace polyp
+
+// The replacements are linked in with count(), so every build that checks a scope counts its allocations.
+// Memory allocated by the driver and by VMA through malloc is not counted.
+
+void* operator new(std::size_t size)
+{
+    if (auto* ptr = polyp::alloc::allocate(size))
+        return ptr;
+
+    throw std::bad_alloc();
+}
+
+void* operator new[](std::size_t size)
+{
+    return operator new(size);
+}
+
+void* operator new(std::size_t size, const std::nothrow_t&) noexcept
+{
+    return polyp::alloc::allocate(size);
+}
+
+void* operator new[](std::size_t size, const std::nothrow_t&) noexcept
+{
+    return polyp::alloc::allocate(size);
+}
+
+void* operator new(std::size_t size, std::align_val_t align)
+{
+    if (auto* ptr = polyp::alloc::allocate(size, align))
+        return ptr;
+
+    throw std::bad_alloc();
+}
+
+void* operator new[](std::size_t size, std::align_val_t align)
+{
+    return operator new(size, align);
+}
+
+void* operator new(std::size_t size, std::align_val_t align, const std::nothrow_t&) noexcept
+{
+    return polyp::alloc::allocate(size, align);
+}
+
+void* operator new[](std::size_t size, std::align_val_t align, const std::nothrow_t&) noexcept
+{
+    return polyp::alloc::allocate(size, align);
+}
+
+void operator delete(void* ptr) noexcept                                                  { std::free(ptr); }
+void operator delete[](void* ptr) noexcept                                                { std::free(ptr); }
+void operator delete(void* ptr, std::size_t) noexcept                                     { std::free(ptr); }
+void operator delete[](void* ptr, std::size_t) noexcept                                   { std::free(ptr); }
+void operator delete(void* ptr, const std::nothrow_t&) noexcept                           { std::free(ptr); }
+void operator delete[](void* ptr, const std::nothrow_t&) noexcept                         { std::free(ptr); }
+void operator delete(void* ptr, std::align_val_t align) noexcept                          { polyp::alloc::release(ptr, align); }
+void operator delete[](void* ptr, std::align_val_t align) noexcept                        { polyp::alloc::release(ptr, align); }
+void operator delete(void* ptr, std::size_t, std::align_val_t align) noexcept             { polyp::alloc::release(ptr, align); }
+void operator delete[](void* ptr, std::size_t, std::align_val_t align) noexcept           { polyp::alloc::release(ptr, align); }
+void operator delete(void* ptr, std::align_val_t align, const std::nothrow_t&) noexcept   { polyp::alloc::release(ptr, align); }
+void operator delete[](void* ptr, std::align_val_t align, const std::nothrow_t&) noexcept { polyp::alloc::release(ptr, align); }
+
+#endif // POLYP_ENABLE_ALLOC_CHECK
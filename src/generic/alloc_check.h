@@ -0,0 +1,49 @@
+#pragma once
+
+#include <cstdint>
+
+namespace polyp {
+namespace alloc {
+
+/// Global operator new calls of the tracked threads since the start. Counted only in builds with
+/// POLYP_ENABLE_ALLOC_CHECK, where alloc_check.cpp replaces the global allocation functions.
+uint64_t count() noexcept;
+
+/// Counts the calling thread's allocations from now on. Checked scopes track their thread and the job
+/// system tracks its workers, other threads (input, simulation) allocate freely meanwhile.
+void track() noexcept;
+
+/// Reports the allocations of a checked scope as a fatal error
+void fail(const char* name, uint64_t allocations);
+
+/// Fails when the heap is allocated between its construction and destruction. Whether the scope
+/// is checked is decided at its end, so code inside the scope may take part in the decision.
+template<typename Armed>
+class Scope
+{
+public:
+    Scope(const char* name, Armed armed) noexcept :
+        mName(name), mArmed(armed)
+    {
+        track();
+        mBegin = count();
+    }
+
+    ~Scope()
+    {
+        const auto allocations = count() - mBegin;
+        if (allocations > 0 && mArmed())
+            fail(mName, allocations);
+    }
+
+    Scope(const Scope&)            = delete;
+    Scope& operator=(const Scope&) = delete;
+
+private:
+    const char* mName;
+    Armed       mArmed;
+    uint64_t    mBegin = 0;
+};
+
+} // namespace alloc
+} // namespace polyp
@@ -1,80 +1,22 @@
 #include "application.h"
 
-#include <os_utils.h>
 #include <global.h>
 
 #ifdef WIN32
+#include <os_utils.h>
 #include <windowsx.h>
 #include <winuser.h>
 #endif
 
 #include <unordered_map>
 #include <thread>
-#include <cctype>
+
+#ifdef WIN32
 
 namespace {
 
 using namespace polyp;
 
-enum class UserMessage
-{
-    Resize = WM_USER + 1,
-    Resized,
-    Quit,
-    MouseClick,
-    MouseMove,
-    MouseWheel,
-    KeyPress,
-    KeyRelease
-};
-
-LRESULT CALLBACK WindowProcedure(HWND hWnd, UINT message, WPARAM wParam, LPARAM lParam)
-{
-    switch (message)
-    {
-    case WM_LBUTTONDOWN:
-        PostMessage(hWnd, static_cast<int>(UserMessage::MouseClick), static_cast<int>(MouseButton::Left), static_cast<int>(MouseActioin::Click));
-        break;
-    case WM_LBUTTONUP:
-        PostMessage(hWnd, static_cast<int>(UserMessage::MouseClick), static_cast<int>(MouseButton::Left), static_cast<int>(MouseActioin::Release));
-        break;
-    case WM_RBUTTONDOWN:
-        PostMessage(hWnd, static_cast<int>(UserMessage::MouseClick), static_cast<int>(MouseButton::Right), static_cast<int>(MouseActioin::Click));
-        break;
-    case WM_RBUTTONUP:
-        PostMessage(hWnd, static_cast<int>(UserMessage::MouseClick), static_cast<int>(MouseButton::Right), static_cast<int>(MouseActioin::Release));
-        break;
-    case WM_MOUSEMOVE:
-        PostMessage(hWnd, static_cast<int>(UserMessage::MouseMove), wParam, lParam);
-        break;
-    case WM_MOUSEWHEEL:
-        PostMessage(hWnd, static_cast<int>(UserMessage::MouseWheel), wParam, lParam);
-        break;
-    case WM_SIZE:
-        PostMessage(hWnd, static_cast<int>(UserMessage::Resize), wParam, lParam);
-        break;
-    case WM_EXITSIZEMOVE:
-        PostMessage(hWnd, static_cast<int>(UserMessage::Resized), 0, 0);
-        break;
-    case WM_KEYDOWN:
-        if (VK_ESCAPE == wParam) {
-            PostMessage(hWnd, static_cast<int>(UserMessage::Quit), 0, 0);
-            break;
-        }
-        PostMessage(hWnd, static_cast<int>(UserMessage::KeyPress), wParam, lParam);
-        break;
-    case WM_KEYUP:
-        PostMessage(hWnd, static_cast<int>(UserMessage::KeyRelease), wParam, lParam);
-        break;
-    case WM_CLOSE:
-        PostMessage(hWnd, static_cast<int>(UserMessage::Quit), 0, 0);
-        break;
-    default:
-        return DefWindowProc(hWnd, message, wParam, lParam);
-    }
-    return 0;
-}
-
 class DPIScale
 {
 public:
@@ -95,6 +37,30 @@ private:
 };
 
 float DPIScale::scale = 1.0f;
+
+InputEvent::Key toKey(WPARAM key)
+{
+    switch (key)
+    {
+    case 'W':        return InputEvent::Key::Ahead;
+    case 'S':        return InputEvent::Key::Back;
+    case 'A':        return InputEvent::Key::Left;
+    case 'D':        return InputEvent::Key::Right;
+    case VK_SPACE:   return InputEvent::Key::Up;
+    case VK_CONTROL: return InputEvent::Key::Down;
+    case VK_END:     return InputEvent::Key::Reset;
+    default:         return InputEvent::Key::None;
+    }
+}
+
+InputEvent clickEvent(MouseButton button, MouseActioin action)
+{
+    InputEvent event{};
+    event.type  = InputEvent::Type::MouseClick;
+    event.click = MouseClickEventArgs{ button, action };
+    return event;
+}
+
 }
 
 namespace polyp {
@@ -110,7 +76,7 @@ bool Application::init(const char* title, int width, int height)
     WNDCLASSEX winClass = {
         sizeof(WNDCLASSEX),                  // UINT      cbSize
         CS_HREDRAW | CS_VREDRAW,             // UINT      style
-        WindowProcedure,                     // WNDPROC   lpfnWndProc
+        windowProcedure,                     // WNDPROC   lpfnWndProc
         0,                                   // int       cbClsExtra
         0,                                   // int       cbWndExtra
         mWindowInstance,                     // HINSTANCE hInstance
@@ -133,12 +99,78 @@ bool Application::init(const char* title, int width, int height)
 
     DPIScale::init(mWindowHandle);
 
-    WindowInitializedEventArgs args{ mWindowHandle, mWindowInstance };
+    WindowInitializedEventArgs args{ mWindowHandle, mWindowInstance, static_cast<uint32_t>(width), static_cast<uint32_t>(height) };
     onWindowInitialized(args);
 
     return true;
 }
 
+LRESULT CALLBACK Application::windowProcedure(HWND hWnd, UINT message, WPARAM wParam, LPARAM lParam)
+{
+    auto& app = Application::get();
+
+    // Queued here rather than posted back to the pump, so input sent during modal size loops is not lost
+    InputEvent event{};
+
+    switch (message)
+    {
+    case WM_LBUTTONDOWN:
+        app.post(clickEvent(MouseButton::Left, MouseActioin::Click));
+        break;
+    case WM_LBUTTONUP:
+        app.post(clickEvent(MouseButton::Left, MouseActioin::Release));
+        break;
+    case WM_RBUTTONDOWN:
+        app.post(clickEvent(MouseButton::Right, MouseActioin::Click));
+        break;
+    case WM_RBUTTONUP:
+        app.post(clickEvent(MouseButton::Right, MouseActioin::Release));
+        break;
+    case WM_MOUSEMOVE:
+        event.type = InputEvent::Type::MouseMove;
+        event.x    = DPIScale::convert(GET_X_LPARAM(lParam));
+        event.y    = DPIScale::convert(GET_Y_LPARAM(lParam));
+        app.post(event);
+        break;
+    case WM_MOUSEWHEEL:
+        event.type  = InputEvent::Type::MouseWheel;
+        event.wheel = static_cast<float>(GET_WHEEL_DELTA_WPARAM(wParam) / WHEEL_DELTA);
+        event.x     = DPIScale::convert(GET_X_LPARAM(lParam));
+        event.y     = DPIScale::convert(GET_Y_LPARAM(lParam));
+        app.post(event);
+        break;
+    case WM_SIZE:
+        event.type   = InputEvent::Type::Resize;
+        event.resize = WindowResizeEventArgs{ static_cast<WindowResizeMode>(wParam), LOWORD(lParam), HIWORD(lParam) };
+        app.post(event);
+        break;
+    case WM_EXITSIZEMOVE:
+        event.type   = InputEvent::Type::Resize;
+        event.resize = WindowResizeEventArgs{ WindowResizeMode::ExitSizeMove, 0, 0 };
+        app.post(event);
+        break;
+    case WM_KEYDOWN:
+    case WM_KEYUP:
+        if (message == WM_KEYDOWN && VK_ESCAPE == wParam) {
+            app.mStopRendering.store(true);
+            PostQuitMessage(0);
+            break;
+        }
+        event.type = message == WM_KEYDOWN ? InputEvent::Type::KeyPress : InputEvent::Type::KeyRelease;
+        event.key  = toKey(wParam);
+        if (event.key != InputEvent::Key::None)
+            app.post(event);
+        break;
+    case WM_CLOSE:
+        app.mStopRendering.store(true);
+        PostQuitMessage(0);
+        break;
+    default:
+        return DefWindowProc(hWnd, message, wParam, lParam);
+    }
+    return 0;
+}
+
 void Application::run()
 {
     if (!mWindowHandle || !mWindowInstance) {
@@ -148,9 +180,6 @@ void Application::run()
     ShowWindow(mWindowHandle, SW_SHOWNORMAL);
     UpdateWindow(mWindowHandle);
 
-    MSG message;
-    MovementEventArgs movement{};
-
     std::atomic_bool trackCursor{ false };
 
     auto trackCursorFunc = [](HWND win, std::atomic_bool& output, std::atomic_bool& stopToken) {
@@ -161,135 +190,47 @@ void Application::run()
     };
     std::thread trackCursorThread{ trackCursorFunc, mWindowHandle, std::ref(trackCursor), std::ref(mStopRendering) };
 
-    while (!mStopRendering.load())
-    {
-        while (PeekMessage(&message, NULL, 0, 0, PM_REMOVE))
+    // Frames are rendered on their own thread, so a slow frame does not delay input sampling and a burst of
+    // input does not delay the frame. Every event fires on the render thread.
+    const DWORD pumpThread = GetCurrentThreadId();
+
+    std::thread renderThread{ [this, &trackCursor, pumpThread]() {
+        MovementEventArgs movement{};
+
+        while (!mStopRendering.load())
         {
-            switch (static_cast<UserMessage>(message.message))
+            POLYPTRACE("Frame");
+
+            if (!trackCursor.load(std::memory_order_relaxed))
             {
-                case UserMessage::MouseClick:
-                {
-                    MouseClickEventArgs args {
-                        static_cast<MouseButton>(message.wParam),
-                        static_cast<MouseActioin>(message.lParam)
-                    };
-                    onMouseClick(args);
-                    break;
-                }
-                case UserMessage::MouseMove:
-                {
-                    movement.mouse.x = DPIScale::convert(GET_X_LPARAM(message.lParam));
-                    movement.mouse.y = DPIScale::convert(GET_Y_LPARAM(message.lParam));
-                    break;
-                }
-                case UserMessage::MouseWheel:
-                {
-                    movement.mouse.wheel += GET_WHEEL_DELTA_WPARAM(message.wParam) / WHEEL_DELTA;
-                    movement.mouse.x      = DPIScale::convert(GET_X_LPARAM(message.lParam));
-                    movement.mouse.y      = DPIScale::convert(GET_Y_LPARAM(message.lParam));
-                    break;
-                }
-                case UserMessage::Resize:
-                {
-                    WindowResizeEventArgs args
-                    {
-                        .mode   = static_cast<WindowResizeMode>(message.wParam),
-                        .width  = HIWORD(message.lParam),
-                        .height = LOWORD(message.lParam)
-                    };
-                    onWindowResized(args);
-                    break;
-                }
-                case UserMessage::Resized:
-                {
-                    WindowResizeEventArgs args
-                    {
-                        .mode   = WindowResizeMode::ExitSizeMove,
-                        .width  = 0,
-                        .height = 0
-                    };
-                    onWindowResized(args);
-                    break;
-                }
-                case UserMessage::Quit:
-                {
-                    mStopRendering.store(true);
-                    break;
-                }
-                case UserMessage::KeyPress:
-                {
-                    if ((message.wParam >> 8) > 0)
-                        break;
-
-                    char key = static_cast<char>(message.wParam);
-
-                    if (key == VK_SPACE)
-                        movement.move.up = true;
-                    else if (key == VK_CONTROL)
-                        movement.move.down = true;
-                    else if (key == VK_END)
-                        movement.reset = true;
-
-                    key = std::tolower(key);
-
-                    if (key == 'w')
-                        movement.move.ahead = true;
-                    else if (key == 's')
-                        movement.move.back = true;
-                    else if (key == 'a')
-                        movement.move.left = true;
-                    else if (key == 'd')
-                        movement.move.righ = true;
-
-                    break;
-                }
-                case UserMessage::KeyRelease:
-                {
-                    if ((message.wParam >> 8) > 0)
-                        break;
-
-                    char key = static_cast<char>(message.wParam);
-
-                    if (key == VK_SPACE)
-                        movement.move.up = false;
-                    else if (key == VK_CONTROL)
-                        movement.move.down = false;
-                    else if (key == VK_END)
-                        movement.reset = false;
-
-                    key = std::tolower(key);
-
-                    if (key == 'w')
-                        movement.move.ahead = false;
-                    else if (key == 's')
-                        movement.move.back = false;
-                    else if (key == 'a')
-                        movement.move.left = false;
-                    else if (key == 'd')
-                        movement.move.righ = false;
-
-                    break;
-                }
+                MouseClickEventArgs args{ MouseButton::Left, MouseActioin::Release };
+                onMouseClick(args);
             }
 
-            TranslateMessage(&message);
-            DispatchMessage(&message);
-
+            frame(movement);
         }
 
-        if (!trackCursor.load(std::memory_order_relaxed))
-        {
-            MouseClickEventArgs args{ MouseButton::Left, MouseActioin::Release };
-            onMouseClick(args);
-        }
+        onShutdown();
 
-        onMovement(movement);
-        onRender();
+        // The pump blocks in GetMessage, wake it up in case rendering stopped without a window message
+        mStopRendering.store(true);
+        PostThreadMessage(pumpThread, WM_NULL, 0, 0);
+    } };
+
+    // The thread that created the window pumps its messages, the window procedure queues the input
+    MSG message;
+    while (!mStopRendering.load() && GetMessage(&message, NULL, 0, 0) > 0)
+    {
+        TranslateMessage(&message);
+        DispatchMessage(&message);
     }
 
-    onShutdown();
+    mStopRendering.store(true);
 
+    renderThread.join();
     trackCursorThread.join();
+
+    POLYPTRACEFLUSH(POLYP_TRACE_FILE);
 }
 
 void Application::destroyWindow()
@@ -305,3 +246,134 @@ void Application::destroyWindow()
 }
 
 }
+
+#else // !WIN32
+
+namespace polyp {
+
+/// There is no window system, so the sample is rendered offscreen for a fixed number of frames
+bool Application::init(const char* title, int width, int height)
+{
+    POLYPINFO("Window system is not available, %s will be rendered offscreen (%dx%d)", title, width, height);
+
+    WindowInitializedEventArgs args{ NULL, NULL, static_cast<uint32_t>(width), static_cast<uint32_t>(height) };
+    onWindowInitialized(args);
+
+    return true;
+}
+
+void Application::run()
+{
+    MovementEventArgs movement{};
+
+    const auto start = std::chrono::high_resolution_clock::now();
+
+    uint32_t frames = 0;
+    for (; frames < POLYP_HEADLESS_FRAMES && !mStopRendering.load(); ++frames)
+    {
+        POLYPTRACE("Frame");
+
+        frame(movement);
+    }
+
+    onShutdown();
+
+    const auto duration = std::chrono::duration<double>(std::chrono::high_resolution_clock::now() - start).count();
+    POLYPINFO("Rendered %u frames in %.3f s (%.1f fps)", frames, duration, frames / duration);
+
+    POLYPTRACEFLUSH(POLYP_TRACE_FILE);
+}
+
+void Application::destroyWindow()
+{
+    mWindowHandle   = NULL;
+    mWindowInstance = NULL;
+}
+
+}
+
+#endif // WIN32
+
+namespace polyp {
+
+namespace {
+
+uint64_t now()
+{
+    using namespace std::chrono;
+    return duration_cast<nanoseconds>(steady_clock::now().time_since_epoch()).count();
+}
+
+}
+
+void Application::post(InputEvent event)
+{
+    event.time = now();
+
+    if (!mInput.push(event))
+        mDroppedInput.fetch_add(1, std::memory_order_relaxed);
+}
+
+void Application::frame(MovementEventArgs& movement)
+{
+    InputEvent event;
+    while (mInput.pop(event))
+        apply(event, movement);
+
+    if (const auto dropped = mDroppedInput.exchange(0, std::memory_order_relaxed); dropped > 0)
+        POLYPWARN("%llu input events are dropped, the input queue is full", static_cast<unsigned long long>(dropped));
+
+    onMovement(movement);
+    onRender();
+}
+
+void Application::apply(const InputEvent& event, MovementEventArgs& movement)
+{
+    switch (event.type)
+    {
+    case InputEvent::Type::MouseMove:
+    case InputEvent::Type::MouseWheel:
+    {
+        // Every move reaches the listeners in order, so the path of a drag is kept rather than its end only
+        MovementEventArgs pointer{};
+        pointer.mouse.x     = event.x;
+        pointer.mouse.y     = event.y;
+        pointer.mouse.wheel = event.wheel;
+        pointer.time        = event.time;
+        onMovement(pointer);
+
+        movement.mouse.x = event.x;
+        movement.mouse.y = event.y;
+        movement.time    = event.time;
+        break;
+    }
+    case InputEvent::Type::MouseClick:
+        onMouseClick(event.click);
+        break;
+    case InputEvent::Type::KeyPress:
+    case InputEvent::Type::KeyRelease:
+    {
+        const bool pressed = event.type == InputEvent::Type::KeyPress;
+
+        switch (event.key)
+        {
+        case InputEvent::Key::Ahead: movement.move.ahead = pressed; break;
+        case InputEvent::Key::Back:  movement.move.back  = pressed; break;
+        case InputEvent::Key::Left:  movement.move.left  = pressed; break;
+        case InputEvent::Key::Right: movement.move.righ  = pressed; break;
+        case InputEvent::Key::Up:    movement.move.up    = pressed; break;
+        case InputEvent::Key::Down:  movement.move.down  = pressed; break;
+        case InputEvent::Key::Reset: movement.reset      = pressed; break;
+        default:                                                    break;
+        }
+
+        movement.time = event.time;
+        break;
+    }
+    case InputEvent::Type::Resize:
+        onWindowResized(event.resize);
+        break;
+    }
+}
+
+}
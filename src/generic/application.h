@@ -1,6 +1,9 @@
 #pragma once
 
 #include "event.h"
+#include "spsc_queue.h"
+
+#include <global.h>
 
 #ifdef WIN32
 #include <Windows.h>
@@ -34,6 +37,8 @@ struct WindowInitializedEventArgs
 {
     HWND        windowHandle = NULL;
     HINSTANCE windowInstance = NULL;
+    uint32_t           width = 0;
+    uint32_t          height = 0;
 };
 
 struct WindowResizeEventArgs
@@ -71,6 +76,8 @@ struct MovementEventArgs
 
     bool reset = false;
 
+    uint64_t time = 0; // steady clock nanoseconds of the latest input folded in
+
     bool HasMotion() const
     {
         return move.ahead || move.back || move.righ || move.left || move.up || move.down;
@@ -92,6 +99,41 @@ struct MovementEventArgs
     }
 };
 
+/// Input sampled by the window pump. The frame loop drains the events in the order they arrived.
+struct InputEvent
+{
+    enum class Type : uint8_t
+    {
+        MouseMove,
+        MouseWheel,
+        MouseClick,
+        KeyPress,
+        KeyRelease,
+        Resize
+    };
+
+    enum class Key : uint8_t
+    {
+        None,
+        Ahead,
+        Back,
+        Left,
+        Right,
+        Up,
+        Down,
+        Reset
+    };
+
+    Type                  type   = Type::MouseMove;
+    Key                   key    = Key::None;
+    uint64_t              time   = 0; // steady clock nanoseconds when the pump received it
+    float                 x      = 0;
+    float                 y      = 0;
+    float                 wheel  = 0;
+    MouseClickEventArgs   click  = {};
+    WindowResizeEventArgs resize = {};
+};
+
 class Application final
 {
 public:
@@ -120,9 +162,25 @@ private:
 
     void destroyWindow();
 
+#ifdef WIN32
+    static LRESULT CALLBACK windowProcedure(HWND hWnd, UINT message, WPARAM wParam, LPARAM lParam);
+#endif
+
+    /// Window pump thread: timestamps the event and queues it for the frame loop
+    void post(InputEvent event);
+
+    /// Frame loop thread: applies the queued input, then fires onMovement and onRender
+    void frame(MovementEventArgs& movement);
+
+    /// Pointer events fire onMovement on their own, keys update the movement state of the frame
+    void apply(const InputEvent& event, MovementEventArgs& movement);
+
     HWND               mWindowHandle;
     HINSTANCE        mWindowInstance;
     std::atomic_bool mStopRendering;
+
+    SPSCQueue<InputEvent, POLYP_INPUT_QUEUE_SIZE> mInput;
+    std::atomic<uint64_t>                         mDroppedInput = 0; // events the full queue did not take
 };
 
 }
\ No newline at end of file
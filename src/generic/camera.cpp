@@ -27,6 +27,16 @@ glm::mat4 Camera::view()
     return mCachedView;
 }
 
+void Camera::perspective(float fovy, float aspect, float zNear, float zFar)
+{
+    mProjection = glm::perspective(fovy, aspect, zNear, zFar);
+}
+
+Frustum Camera::frustum()
+{
+    return Frustum::fromMatrix(mProjection * view());
+}
+
 void Camera::processKeyboard(Direction direction, float deltaTime)
 {
     const auto movementSpeed = mSpeed * deltaTime;
@@ -3,6 +3,8 @@
 #include <glm/glm.hpp>
 #include <glm/gtc/matrix_transform.hpp>
 
+#include "frustum.h"
+
 #include <vector>
 
 namespace polyp {
@@ -39,12 +41,20 @@ public:
 
     glm::mat4 view();
 
+    void perspective(float fovy, float aspect, float zNear, float zFar);
+
+    glm::mat4 projection() const { return mProjection; }
+
+    /// World space frustum of the current view and projection
+    Frustum frustum();
+
 private:
     glm::vec3 mUp;
     glm::vec3 mFront;
     glm::vec3 mRight;
     glm::vec3 mWorldUp;
     glm::mat4 mCachedView;
+    glm::mat4 mProjection = glm::mat4(1.0f);
 
     glm::vec3 mPosition;
     glm::vec3 mDefaultPosition;
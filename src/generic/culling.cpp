@@ -0,0 +1,215 @@
+#include "culling.h"
+#include "jobs.h"
+
+#include <global.h>
+
+#if defined(__AVX2__)
+    #include <immintrin.h>
+    #define POLYP_CULLING_AVX2
+#elif defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+    #include <emmintrin.h>
+    #define POLYP_CULLING_SSE
+#endif
+
+namespace polyp {
+
+namespace {
+
+void cullScalarRange(const Frustum& frustum, const BoundsSoA& bounds, size_t begin, size_t end, std::vector<uint32_t>& visible)
+{
+    for (size_t i = begin; i < end; ++i)
+    {
+        if (frustum.intersects({ bounds.x[i], bounds.y[i], bounds.z[i] }, bounds.radius[i]))
+            visible.push_back(static_cast<uint32_t>(i));
+    }
+}
+
+#if defined(POLYP_CULLING_AVX2)
+
+constexpr size_t kLanes = 8;
+
+void cullRange(const Frustum& frustum, const BoundsSoA& bounds, size_t begin, size_t end, std::vector<uint32_t>& visible)
+{
+    __m256 px[Frustum::Count], py[Frustum::Count], pz[Frustum::Count], pw[Frustum::Count];
+    for (size_t p = 0; p < Frustum::Count; ++p)
+    {
+        px[p] = _mm256_set1_ps(frustum.planes[p].x);
+        py[p] = _mm256_set1_ps(frustum.planes[p].y);
+        pz[p] = _mm256_set1_ps(frustum.planes[p].z);
+        pw[p] = _mm256_set1_ps(frustum.planes[p].w);
+    }
+
+    const __m256 zero = _mm256_setzero_ps();
+
+    size_t i = begin;
+    for (; i + kLanes <= end; i += kLanes)
+    {
+        const __m256 x = _mm256_loadu_ps(bounds.x.data() + i);
+        const __m256 y = _mm256_loadu_ps(bounds.y.data() + i);
+        const __m256 z = _mm256_loadu_ps(bounds.z.data() + i);
+        const __m256 r = _mm256_sub_ps(zero, _mm256_loadu_ps(bounds.radius.data() + i));
+
+        __m256 outside = zero;
+        for (size_t p = 0; p < Frustum::Count; ++p)
+        {
+            // Summed as in Frustum::intersects, so spheres touching a plane are classified alike
+            const __m256 xy = _mm256_add_ps(_mm256_mul_ps(px[p], x), _mm256_mul_ps(py[p], y));
+            const __m256 d  = _mm256_add_ps(_mm256_add_ps(xy, _mm256_mul_ps(pz[p], z)), pw[p]);
+            outside = _mm256_or_ps(outside, _mm256_cmp_ps(d, r, _CMP_LT_OQ));
+        }
+
+        for (uint32_t mask = ~_mm256_movemask_ps(outside) & 0xFFu; mask != 0; mask &= mask - 1)
+        {
+            uint32_t lane = 0;
+            while (!(mask & (1u << lane)))
+                ++lane;
+
+            visible.push_back(static_cast<uint32_t>(i + lane));
+        }
+    }
+
+    cullScalarRange(frustum, bounds, i, end, visible);
+}
+
+#elif defined(POLYP_CULLING_SSE)
+
+constexpr size_t kLanes = 4;
+
+void cullRange(const Frustum& frustum, const BoundsSoA& bounds, size_t begin, size_t end, std::vector<uint32_t>& visible)
+{
+    __m128 px[Frustum::Count], py[Frustum::Count], pz[Frustum::Count], pw[Frustum::Count];
+    for (size_t p = 0; p < Frustum::Count; ++p)
+    {
+        px[p] = _mm_set1_ps(frustum.planes[p].x);
+        py[p] = _mm_set1_ps(frustum.planes[p].y);
+        pz[p] = _mm_set1_ps(frustum.planes[p].z);
+        pw[p] = _mm_set1_ps(frustum.planes[p].w);
+    }
+
+    const __m128 zero = _mm_setzero_ps();
+
+    size_t i = begin;
+    for (; i + kLanes <= end; i += kLanes)
+    {
+        const __m128 x = _mm_loadu_ps(bounds.x.data() + i);
+        const __m128 y = _mm_loadu_ps(bounds.y.data() + i);
+        const __m128 z = _mm_loadu_ps(bounds.z.data() + i);
+        const __m128 r = _mm_sub_ps(zero, _mm_loadu_ps(bounds.radius.data() + i));
+
+        __m128 outside = zero;
+        for (size_t p = 0; p < Frustum::Count; ++p)
+        {
+            // Summed as in Frustum::intersects, so spheres touching a plane are classified alike
+            const __m128 xy = _mm_add_ps(_mm_mul_ps(px[p], x), _mm_mul_ps(py[p], y));
+            const __m128 d  = _mm_add_ps(_mm_add_ps(xy, _mm_mul_ps(pz[p], z)), pw[p]);
+            outside = _mm_or_ps(outside, _mm_cmplt_ps(d, r));
+        }
+
+        const int mask = ~_mm_movemask_ps(outside);
+        for (uint32_t lane = 0; lane < kLanes; ++lane)
+        {
+            if (mask & (1 << lane))
+                visible.push_back(static_cast<uint32_t>(i + lane));
+        }
+    }
+
+    cullScalarRange(frustum, bounds, i, end, visible);
+}
+
+#else
+
+constexpr size_t kLanes = 1;
+
+void cullRange(const Frustum& frustum, const BoundsSoA& bounds, size_t begin, size_t end, std::vector<uint32_t>& visible)
+{
+    cullScalarRange(frustum, bounds, begin, end, visible);
+}
+
+#endif
+
+} // namespace
+
+void BoundsSoA::reserve(size_t count)
+{
+    x.reserve(count);
+    y.reserve(count);
+    z.reserve(count);
+    radius.reserve(count);
+}
+
+void BoundsSoA::clear()
+{
+    x.clear();
+    y.clear();
+    z.clear();
+    radius.clear();
+}
+
+void BoundsSoA::push(const glm::vec3& center, float sphereRadius)
+{
+    x.push_back(center.x);
+    y.push_back(center.y);
+    z.push_back(center.z);
+    radius.push_back(sphereRadius);
+}
+
+void BoundsSoA::push(const BoundingBox& box)
+{
+    push(box.center, 0.5f * glm::length(glm::vec3(box.length, box.height, box.width)));
+}
+
+size_t cull(const Frustum& frustum, const BoundsSoA& bounds, std::vector<uint32_t>& visible)
+{
+    POLYPTRACE("CPU culling");
+
+    visible.clear();
+
+    auto& jobs = JobSystem::get();
+
+    // Chunks are multiples of the SIMD width, so only the last one has a scalar tail
+    const size_t count  = bounds.size();
+    const size_t chunk  = (std::max<size_t>(POLYP_CPU_CULLING_PARALLEL, 1) + kLanes - 1) / kLanes * kLanes;
+    const auto   chunks = static_cast<uint32_t>((count + chunk - 1) / chunk);
+
+    if (chunks <= 1 || jobs.threads() == 1)
+    {
+        cullRange(frustum, bounds, 0, count, visible);
+        return visible.size();
+    }
+
+    // Kept per calling thread and sized for a whole chunk, so culling does not allocate once they exist.
+    // Jobs reach them through a reference, a thread_local name resolves to the running thread's lists.
+    thread_local std::vector<std::vector<uint32_t>> lists;
+    if (lists.size() < chunks)
+    {
+        lists.resize(chunks);
+        for (auto& list : lists)
+            list.reserve(chunk);
+    }
+
+    auto& results = lists;
+
+    jobs.parallelFor(chunks, 1, [&](uint32_t begin, uint32_t end) {
+        for (uint32_t i = begin; i < end; ++i)
+        {
+            results[i].clear();
+            cullRange(frustum, bounds, chunk * i, std::min(chunk * (i + 1), count), results[i]);
+        }
+    });
+
+    for (uint32_t i = 0; i < chunks; ++i)
+        visible.insert(visible.end(), results[i].begin(), results[i].end());
+
+    return visible.size();
+}
+
+size_t cullScalar(const Frustum& frustum, const BoundsSoA& bounds, std::vector<uint32_t>& visible)
+{
+    visible.clear();
+
+    cullScalarRange(frustum, bounds, 0, bounds.size(), visible);
+
+    return visible.size();
+}
+
+} // namespace polyp
@@ -0,0 +1,39 @@
+#pragma once
+
+#include "frustum.h"
+#include "model_loader.h"
+
+#include <glm/glm.hpp>
+
+#include <vector>
+
+namespace polyp {
+
+/// Bounding spheres as separate arrays, so SIMD kernels load several spheres per instruction
+struct BoundsSoA
+{
+    std::vector<float> x;
+    std::vector<float> y;
+    std::vector<float> z;
+    std::vector<float> radius;
+
+    size_t size() const noexcept { return x.size(); }
+
+    void reserve(size_t count);
+    void clear();
+
+    void push(const glm::vec3& center, float sphereRadius);
+
+    /// The sphere around the box
+    void push(const BoundingBox& box);
+};
+
+/// Writes the indices of the spheres intersecting the frustum, in ascending order, and returns their count.
+/// Tests 8 spheres per instruction with AVX2 (POLYP_ENABLE_AVX2), 4 with SSE otherwise. Sets larger than
+/// POLYP_CPU_CULLING_PARALLEL spheres are culled in chunks of that size on the job system.
+size_t cull(const Frustum& frustum, const BoundsSoA& bounds, std::vector<uint32_t>& visible);
+
+/// Scalar reference of cull(), one sphere at a time on the calling thread
+size_t cullScalar(const Frustum& frustum, const BoundsSoA& bounds, std::vector<uint32_t>& visible);
+
+} // namespace polyp
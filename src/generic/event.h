@@ -1,306 +1,251 @@
 #pragma once
 
 #include <typeinfo>
-#include <functional>
-#include <stdexcept>
-#include <memory>
-#include <atomic>
+#include <type_traits>
+#include <cstddef>
+#include <cstdint>
 #include <cstring>
+#include <utility>
+#include <atomic>
+#include <mutex>
+#include <vector>
+#include <new>
 
 namespace polyp {
 
 template <typename FuncType>
-class Event;
+class Delegate;
 
+/// Type-erased callable stored inline, creating and calling it never allocates. Holds trivially
+/// copyable callables up to kSize bytes: lambdas capturing references or pointers and bound member functions.
 template <class RetType, class... Args>
-class Event<RetType(Args ...)> final
+class Delegate<RetType(Args ...)> final
 {
-private:
-    struct ComparableClosure;
-    struct ClosureList;
+public:
+    static constexpr size_t kSize = 4 * sizeof(void*);
 
-    using Closure        = std::function<RetType(Args ...)>;
-    using ClosureListPtr = std::shared_ptr<ClosureList>;
+    Delegate() = default;
 
-    struct ComparableClosure
+    template <typename F, typename = std::enable_if_t<!std::is_same_v<std::decay_t<F>, Delegate>>>
+    Delegate(F&& f)
     {
-        Closure  mExecutable;
-
-        struct
-        {
-            void*      object = nullptr;
-            uint8_t* function = nullptr;
-            int          size = 0;
-        } mBound;
-
-        ComparableClosure(const ComparableClosure &) = delete;
-
-        ComparableClosure() { }
-         
-        ComparableClosure(Closure &&closure) : mExecutable(std::move(closure)) { }
-
-        ~ComparableClosure()
-        {
-            if (mBound.function != nullptr)
-                delete[] mBound.function;
-        }
+        assign(std::forward<F>(f), false);
+    }
 
-        ComparableClosure & operator=(const ComparableClosure &closure)
-        {
-            mExecutable   = closure.mExecutable;
-            mBound.object = closure.mBound.object;
-            mBound.size   = closure.mBound.size;
-            if (closure.mBound.size == 0)
-            {
-                mBound.function = nullptr;
-            }
-            else
-            {
-                mBound.function = new uint8_t[closure.mBound.size];
-                std::memcpy(mBound.function, closure.mBound.function, closure.mBound.size);
-            }
+    template <typename TObject>
+    static Delegate bind(RetType(TObject::*function)(Args...), TObject* object)
+    {
+        Delegate output;
+        output.assign(Bound<TObject>{ object, function }, true);
+        return output;
+    }
 
-            return *this;
-        }
+    explicit operator bool() const noexcept { return mInvoke != nullptr; }
 
-        bool operator==(const ComparableClosure &closure)
-        {
-            if (mBound.object == nullptr && closure.mBound.object == nullptr)
-            {
-                return mExecutable.target_type() == closure.mExecutable.target_type();
-            }
-            else
-            {
-                return mBound.object == closure.mBound.object && mBound.size == closure.mBound.size
-                    && std::memcmp(mBound.function, closure.mBound.function, mBound.size) == 0;
-            }
-        }
-    };
-
-    struct ClosureList
+    RetType operator()(Args... args) const
     {
-        ComparableClosure *Closures;
-        int Count;
-
-        ClosureList(ComparableClosure *closures, int count)
-        {
-            Closures = closures;
-            Count = count;
-        }
+        return mInvoke(mData, std::forward<Args>(args)...);
+    }
 
-        ~ClosureList()
-        {
-            delete[] Closures;
-        }
-    };
+    /// Delegates of the same callable type are equal, bound ones have to bind the same object and function as well
+    bool operator==(const Delegate& rhv) const noexcept
+    {
+        if (mType == nullptr || rhv.mType == nullptr)
+            return mType == rhv.mType;
 
-private:
-    ClosureListPtr m_events;
+        return *mType == *rhv.mType && mBoundSize == rhv.mBoundSize && std::memcmp(mData, rhv.mData, mBoundSize) == 0;
+    }
 
 private:
-    bool add(const ComparableClosure &closure)
+    template <typename TObject>
+    struct Bound
     {
-        auto events = std::atomic_load(&m_events);
-        int count;
-        ComparableClosure *closures;
-        if (events == nullptr)
-        {
-            count = 0;
-            closures = nullptr;
-        }
-        else
-        {
-            count = events->Count;
-            closures = events->Closures;
-        }
+        TObject* object;
+        RetType (TObject::*function)(Args...);
 
-        auto newCount = count + 1;
-        auto newClosures = new ComparableClosure[newCount];
-        if (count != 0)
+        RetType operator()(Args... args) const
         {
-            for (int i = 0; i < count; i++)
-                newClosures[i] = closures[i];
+            return (object->*function)(std::forward<Args>(args)...);
         }
+    };
 
-        newClosures[count] = closure;
-        auto newEvents = ClosureListPtr(new ClosureList(newClosures, newCount));
-        if (std::atomic_compare_exchange_weak(&m_events, &events, newEvents))
-            return true;
-
-        return false;
-    }
-
-    bool remove(const ComparableClosure &closure)
+    template <typename F>
+    void assign(F&& f, bool bound)
     {
-        auto events = std::atomic_load(&m_events);
-        if (events == nullptr)
-            return true;
-
-        int index = -1;
-        auto count = events->Count;
-        auto closures = events->Closures;
-        for (int i = 0; i < count; i++)
-        {
-            if (closures[i] == closure)
-            {
-                index = i;
-                break;
-            }
-        }
-
-        if (index == -1)
-            return true;
+        using Fn = std::decay_t<F>;
+        static_assert(sizeof(Fn) <= kSize && alignof(Fn) <= alignof(std::max_align_t), "Delegate callable is too large");
+        static_assert(std::is_trivially_copyable_v<Fn> && std::is_trivially_destructible_v<Fn>, "Delegate callable must be trivially copyable");
 
-        auto newCount = count - 1;
-        ClosureListPtr newEvents;
-        if (newCount == 0) 
-        {
-            newEvents = nullptr;
-        }
-        else
-        {
-            auto newClosures = new ComparableClosure[newCount];
-            for (int i = 0; i < index; i++)
-                newClosures[i] = closures[i];
+        new (mData) Fn(std::forward<F>(f));
+        mInvoke = [](const std::byte* data, Args... args) -> RetType {
+            const auto& callable = *std::launder(reinterpret_cast<const Fn*>(data));
+            if constexpr (std::is_void_v<RetType>)
+                callable(std::forward<Args>(args)...);
+            else
+                return callable(std::forward<Args>(args)...);
+        };
+        mType      = &typeid(Fn);
+        mBoundSize = bound ? static_cast<uint32_t>(sizeof(Fn)) : 0;
+    }
 
-            for (int i = index + 1; i < count; i++)
-                newClosures[i - 1] = closures[i];
+    using Invoke = RetType (*)(const std::byte* data, Args... args);
 
-            newEvents = ClosureListPtr(new ClosureList(newClosures, newCount));
-        }
+    Invoke                mInvoke    = nullptr;
+    const std::type_info* mType      = nullptr;
+    uint32_t              mBoundSize = 0; // bytes compared by operator==, 0 for unbound callables
 
-        if (std::atomic_compare_exchange_weak(&m_events, &events, newEvents))
-            return true;
+    alignas(std::max_align_t) std::byte mData[kSize] = {};
+};
 
-        return false;
-    }
+template <typename FuncType>
+class Event;
 
+/// Multicast delegate. Dispatch reads the listener list with a single acquire load, it takes no lock
+/// and touches no reference count. Subscriptions copy the list under a writer lock and publish the copy.
+/// A replaced list may still be walked by a running dispatch, so it is kept until the event is destroyed:
+/// listeners are subscribed a few times per run, which keeps the retired lists few and small.
+template <class RetType, class... Args>
+class Event<RetType(Args ...)> final
+{
 public:
+    using Listener = Delegate<RetType(Args ...)>;
+
     Event() = default;
 
-    Event(const Event &event)
+    Event(const Event& event)
     {
         *this = event;
     }
 
     ~Event()
     {
-        *this = nullptr;
+        delete mListeners.load(std::memory_order_relaxed);
+
+        while (mRetired != nullptr)
+            delete std::exchange(mRetired, mRetired->retired);
     }
 
-    void operator =(const Event &event)
+    void operator=(const Event& event)
     {
-        std::atomic_store(&m_events, std::atomic_load(&event.m_events));
+        if (this == &event)
+            return;
+
+        const auto* list = event.mListeners.load(std::memory_order_acquire);
+
+        std::lock_guard lock(mWriteLock);
+        publish(list != nullptr ? new List{ list->listeners } : nullptr);
     }
 
-    void operator=(nullptr_t nullpointer)
+    void operator=(std::nullptr_t)
     {
-        while (true)
-        {
-            auto events = std::atomic_load(&m_events);
-            if (!std::atomic_compare_exchange_weak(&m_events, &events, ClosureListPtr()))
-                continue;
-
-            break;
-        }
+        std::lock_guard lock(mWriteLock);
+        publish(nullptr);
     }
 
-    bool operator==(nullptr_t nullpointer)
+    bool operator==(std::nullptr_t) const
     {
-        auto events = std::atomic_load(&m_events);
-        return events == nullptr;
+        return mListeners.load(std::memory_order_acquire) == nullptr;
     }
 
-    bool operator!=(nullptr_t nullpointer)
+    bool operator!=(std::nullptr_t) const
     {
-        auto events = std::atomic_load(&m_events);
-        return events != nullptr;
+        return mListeners.load(std::memory_order_acquire) != nullptr;
     }
 
-    void operator+=(Closure f)
+    template <typename F>
+    void operator+=(F&& f)
     {
-        ComparableClosure closure(std::move(f));
-        while (true)
-        {
-            if (add(closure))
-                break;
-        }
+        add(Listener(std::forward<F>(f)));
     }
 
-    void operator-=(Closure f)
+    template <typename F>
+    void operator-=(F&& f)
     {
-        ComparableClosure closure(std::move(f));
-        while (true)
-        {
-            if (remove(closure))
-                break;
-        }
+        remove(Listener(std::forward<F>(f)));
     }
 
     template <typename TObject>
     void bind(RetType(TObject::*function)(Args...), TObject *object)
     {
-        ComparableClosure closure;
-        closure.mExecutable = [object, function](Args&&...args)
-        {
-            return (object->*function)(std::forward<Args>(args)...);
-        };
-        closure.mBound.size = sizeof(function);
-        closure.mBound.function = new uint8_t[closure.mBound.size];
-        std::memcpy(closure.mBound.function, (void*)&function, sizeof(function));
-        closure.mBound.object = object;
-
-        while (true)
-        {
-            if (add(closure))
-                break;
-        }
+        add(Listener::bind(function, object));
     }
 
     template <typename TObject>
     void unbind(RetType(TObject::*function)(Args...), TObject *object)
     {
-        ComparableClosure closure;
-        closure.mBound.size       = sizeof(function);
-        closure.mBound.function = new uint8_t[closure.mBound.size];
-        std::memcpy(closure.mBound.function, (void*)&function, sizeof(function));
-        closure.mBound.object = object;
-
-        while (true) {
-            if (remove(closure)) {
-                break;
-            }
-        }
+        remove(Listener::bind(function, object));
     }
 
-    void operator()()
+    void operator()(Args... args) const
     {
-        auto events = std::atomic_load(&m_events);
-        if (events == nullptr) {
+        const auto* list = mListeners.load(std::memory_order_acquire);
+        if (list == nullptr)
             return;
-        }
 
-        auto count = events->Count;
-        auto closures = events->Closures;
-        for (int i = 0; i < count; i++) {
-            closures[i].mExecutable();
-        }
+        for (const auto& listener : list->listeners)
+            listener(args...);
     }
 
-    template <typename TArg0, typename ...Args2>
-    void operator()(TArg0 a1, Args2... tail)
+private:
+    struct List
+    {
+        std::vector<Listener> listeners;
+        List*                 retired = nullptr; // the next older replaced list
+    };
+
+    void add(const Listener& listener)
     {
-        auto events = std::atomic_load(&m_events);
-        if (events == nullptr) {
+        std::lock_guard lock(mWriteLock);
+
+        const auto* list = mListeners.load(std::memory_order_relaxed);
+
+        auto* updated = list != nullptr ? new List{ list->listeners } : new List{};
+        updated->listeners.push_back(listener);
+
+        publish(updated);
+    }
+
+    void remove(const Listener& listener)
+    {
+        std::lock_guard lock(mWriteLock);
+
+        const auto* list = mListeners.load(std::memory_order_relaxed);
+        if (list == nullptr)
             return;
-        }
 
-        auto count = events->Count;
-        auto closures = events->Closures;
-        for (int i = 0; i < count; i++) {
-            closures[i].mExecutable(a1, tail...);
+        for (size_t i = 0; i < list->listeners.size(); ++i)
+        {
+            if (!(list->listeners[i] == listener))
+                continue;
+
+            auto* updated = new List{ list->listeners };
+            updated->listeners.erase(updated->listeners.begin() + i);
+
+            if (updated->listeners.empty())
+            {
+                delete updated;
+                updated = nullptr;
+            }
+
+            publish(updated);
+            return;
         }
     }
+
+    /// Called under the writer lock
+    void publish(List* list)
+    {
+        auto* replaced = mListeners.exchange(list, std::memory_order_acq_rel);
+        if (replaced == nullptr)
+            return;
+
+        replaced->retired = mRetired;
+        mRetired          = replaced;
+    }
+
+    std::atomic<List*> mListeners = nullptr;
+    List*              mRetired   = nullptr; // replaced lists, released with the event
+    std::mutex         mWriteLock;
 };
 
 }
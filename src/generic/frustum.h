@@ -0,0 +1,58 @@
+#pragma once
+
+#include <glm/glm.hpp>
+
+#include <array>
+
+namespace polyp {
+
+/// View frustum as six normalized planes, xyz is the inward normal and w the distance.
+/// Planes are extracted from a clip matrix (projection * view [* model]), the near plane follows
+/// the OpenGL clip range of glm::perspective which also contains the Vulkan one.
+struct Frustum
+{
+    enum Plane
+    {
+        Left,
+        Right,
+        Bottom,
+        Top,
+        Near,
+        Far,
+        Count
+    };
+
+    std::array<glm::vec4, Plane::Count> planes = {};
+
+    static Frustum fromMatrix(const glm::mat4& clip)
+    {
+        const auto row = [&clip](int i) { return glm::vec4(clip[0][i], clip[1][i], clip[2][i], clip[3][i]); };
+
+        Frustum frustum;
+        frustum.planes[Left]   = row(3) + row(0);
+        frustum.planes[Right]  = row(3) - row(0);
+        frustum.planes[Bottom] = row(3) + row(1);
+        frustum.planes[Top]    = row(3) - row(1);
+        frustum.planes[Near]   = row(3) + row(2);
+        frustum.planes[Far]    = row(3) - row(2);
+
+        for (auto& plane : frustum.planes)
+            plane /= glm::length(glm::vec3(plane));
+
+        return frustum;
+    }
+
+    /// False if the sphere is entirely outside. The SIMD kernels of culling.h sum the distance in the same order.
+    bool intersects(const glm::vec3& center, float radius) const
+    {
+        for (const auto& plane : planes)
+        {
+            if (((plane.x * center.x + plane.y * center.y) + plane.z * center.z) + plane.w < -radius)
+                return false;
+        }
+
+        return true;
+    }
+};
+
+} // namespace polyp
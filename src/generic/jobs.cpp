@@ -0,0 +1,271 @@
+#include "jobs.h"
+
+#include <global.h>
+
+namespace polyp {
+
+namespace {
+
+constexpr uint32_t kNoIndex    = ~0u;
+constexpr uint32_t kSpinRounds = 64; // empty searches before a worker sleeps
+
+thread_local uint32_t tIndex = kNoIndex;
+
+static_assert(POLYP_JOB_EXTERNAL_THREADS <= 32, "External deques are tracked in a 32-bit mask");
+
+} // namespace
+
+JobSystem::ExternalSlot::~ExternalSlot()
+{
+    if (system != nullptr)
+        system->mExternal.fetch_and(~(1u << index), std::memory_order_release);
+}
+
+JobSystem& JobSystem::get()
+{
+    static JobSystem instance;
+    return instance;
+}
+
+JobSystem::JobSystem()
+{
+    const uint32_t hardware = std::max(std::thread::hardware_concurrency(), 2u);
+    uint32_t       workers  = POLYP_JOB_WORKERS > 0 ? POLYP_JOB_WORKERS : hardware - 1;
+
+    // The environment variable of the same name overrides the build setting, the benchmarks scale with it.
+    // There 0 means no workers at all, jobs run on the threads waiting for them.
+    if (const char* env = std::getenv("POLYP_JOB_WORKERS"); env != nullptr && *env != '\0')
+    {
+        char*      end   = nullptr;
+        const auto value = std::strtoul(env, &end, 10);
+        if (*end == '\0')
+            workers = static_cast<uint32_t>(value);
+        else
+            POLYPWARN("POLYP_JOB_WORKERS=%s is not a worker count, %u workers are started", env, workers);
+    }
+
+    for (uint32_t i = 0; i < workers + POLYP_JOB_EXTERNAL_THREADS; ++i)
+        mQueues.push_back(std::make_unique<Slot>());
+
+    for (uint32_t i = 0; i < workers; ++i)
+        mWorkers.emplace_back(&JobSystem::work, this, i);
+}
+
+JobSystem::~JobSystem()
+{
+    mStop.store(true, std::memory_order_release);
+    mSignal.fetch_add(1, std::memory_order_release);
+    mSignal.notify_all();
+
+    for (auto& worker : mWorkers)
+        worker.join();
+}
+
+uint32_t JobSystem::threadIndex()
+{
+    if (tIndex == kNoIndex)
+    {
+        // The acquire pairs with the release of a previous owner's exit, its deque is drained by then
+        constexpr uint32_t kAll    = POLYP_JOB_EXTERNAL_THREADS == 32 ? ~0u : (1u << POLYP_JOB_EXTERNAL_THREADS) - 1;
+        uint32_t           claimed = mExternal.load(std::memory_order_relaxed);
+        uint32_t           external;
+
+        do
+        {
+            if ((claimed & kAll) == kAll)
+                POLYPFATAL("More than %u threads outside the job system submit jobs at once", POLYP_JOB_EXTERNAL_THREADS);
+
+            external = 0;
+            while (claimed & (1u << external))
+                ++external;
+        }
+        while (!mExternal.compare_exchange_weak(claimed, claimed | (1u << external), std::memory_order_acquire, std::memory_order_relaxed));
+
+        thread_local ExternalSlot slot;
+        slot.system = this;
+        slot.index  = external;
+
+        tIndex = static_cast<uint32_t>(mWorkers.size()) + external;
+    }
+
+    return tIndex;
+}
+
+void JobSystem::wait(JobCounter& counter)
+{
+    const auto index = threadIndex();
+
+    while (!counter.done())
+    {
+        if (auto* job = find(index))
+            execute(job);
+        else
+            std::this_thread::yield();
+    }
+}
+
+JobSystem::Job* JobSystem::allocate()
+{
+    auto& slot = *mQueues[threadIndex()];
+
+    // The oldest slot may still be queued or running on a thief
+    auto& job = slot.jobs[slot.next % kQueueCapacity];
+    if (job.busy.load(std::memory_order_acquire))
+        return nullptr;
+
+    ++slot.next;
+    job.busy.store(true, std::memory_order_relaxed);
+
+    return &job;
+}
+
+void JobSystem::submit(JobCounter& counter, Job* job)
+{
+    job->counter = &counter;
+    counter.mPending.fetch_add(1, std::memory_order_relaxed);
+
+    if (!mQueues[threadIndex()]->queue.push(job))
+    {
+        execute(job);
+        return;
+    }
+
+    mSignal.fetch_add(1, std::memory_order_release);
+    if (mSleeping.load(std::memory_order_acquire) > 0)
+        mSignal.notify_one();
+}
+
+void JobSystem::execute(Job* job)
+{
+    job->invoke(*job);
+
+    // The slot may be reused once busy is cleared, the counter may be gone once it drops to zero
+    auto* counter = job->counter;
+    job->busy.store(false, std::memory_order_release);
+    counter->mPending.fetch_sub(1, std::memory_order_acq_rel);
+}
+
+JobSystem::Job* JobSystem::find(uint32_t index)
+{
+    if (auto* job = mQueues[index]->queue.pop())
+        return job;
+
+    // Victims in a rotating order starting after the thief, so thieves spread over the deques
+    const auto count = static_cast<uint32_t>(mQueues.size());
+    for (uint32_t i = 1; i < count; ++i)
+    {
+        if (auto* job = mQueues[(index + i) % count]->queue.steal())
+            return job;
+    }
+
+    return nullptr;
+}
+
+void JobSystem::work(uint32_t index)
+{
+    tIndex = index;
+
+    // Jobs run parts of the frames, their allocations count for the frame checks
+    POLYPALLOCTRACK();
+
+    uint32_t idle = 0;
+
+    while (!mStop.load(std::memory_order_acquire))
+    {
+        const auto signal = mSignal.load(std::memory_order_acquire);
+
+        if (auto* job = find(index))
+        {
+            execute(job);
+            idle = 0;
+            continue;
+        }
+
+        if (++idle < kSpinRounds)
+        {
+            std::this_thread::yield();
+            continue;
+        }
+
+        // A submit after the signal was read changes it, so the wait returns at once
+        mSleeping.fetch_add(1, std::memory_order_acq_rel);
+        mSignal.wait(signal, std::memory_order_acquire);
+        mSleeping.fetch_sub(1, std::memory_order_acq_rel);
+        idle = 0;
+    }
+}
+
+void JobSystem::split(JobCounter& counter, void* ctx, RangeFn fn, uint32_t begin, uint32_t end, uint32_t grain)
+{
+    // The upper halves are queued for thieves, the lowest range runs here
+    while (end - begin > grain)
+    {
+        const uint32_t middle = begin + (end - begin) / 2;
+
+        run(counter, [this, &counter, ctx, fn, middle, end, grain]() { split(counter, ctx, fn, middle, end, grain); });
+
+        end = middle;
+    }
+
+    fn(ctx, begin, end);
+}
+
+bool JobSystem::Queue::push(Job* job) noexcept
+{
+    const auto bottom = mBottom.load(std::memory_order_relaxed);
+    const auto top    = mTop.load(std::memory_order_acquire);
+
+    if (bottom - top >= static_cast<int64_t>(kQueueCapacity))
+        return false;
+
+    // Publishes the job's data to the thieves acquiring the bottom
+    mJobs[bottom % kQueueCapacity].store(job, std::memory_order_relaxed);
+    mBottom.store(bottom + 1, std::memory_order_release);
+
+    return true;
+}
+
+JobSystem::Job* JobSystem::Queue::pop() noexcept
+{
+    const auto bottom = mBottom.load(std::memory_order_relaxed) - 1;
+    mBottom.store(bottom, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    auto top = mTop.load(std::memory_order_relaxed);
+
+    if (top > bottom)
+    {
+        mBottom.store(bottom + 1, std::memory_order_relaxed);
+        return nullptr;
+    }
+
+    auto* job = mJobs[bottom % kQueueCapacity].load(std::memory_order_relaxed);
+
+    // The last job, race the thieves for it
+    if (top == bottom)
+    {
+        if (!mTop.compare_exchange_strong(top, top + 1, std::memory_order_seq_cst, std::memory_order_relaxed))
+            job = nullptr;
+
+        mBottom.store(bottom + 1, std::memory_order_relaxed);
+    }
+
+    return job;
+}
+
+JobSystem::Job* JobSystem::Queue::steal() noexcept
+{
+    auto top = mTop.load(std::memory_order_acquire);
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    const auto bottom = mBottom.load(std::memory_order_acquire);
+
+    if (top >= bottom)
+        return nullptr;
+
+    auto* job = mJobs[top % kQueueCapacity].load(std::memory_order_relaxed);
+    if (!mTop.compare_exchange_strong(top, top + 1, std::memory_order_seq_cst, std::memory_order_relaxed))
+        return nullptr;
+
+    return job;
+}
+
+} // namespace polyp
@@ -0,0 +1,174 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <new>
+#include <thread>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+namespace polyp {
+
+class JobSystem;
+
+/// Pending jobs of a fork-join group. A job run with the counter may run children with it as well,
+/// wait() returns when the whole tree has completed.
+class JobCounter
+{
+public:
+    JobCounter() = default;
+
+    JobCounter(const JobCounter&)            = delete;
+    JobCounter& operator=(const JobCounter&) = delete;
+
+    bool done() const noexcept { return mPending.load(std::memory_order_acquire) == 0; }
+
+private:
+    friend class JobSystem;
+
+    std::atomic<uint32_t> mPending = 0;
+};
+
+/// Work-stealing scheduler. Every thread has its own Chase-Lev deque: the owner pushes and pops at
+/// the bottom, idle threads steal the oldest jobs from the top. Worker threads are sized to the
+/// machine (POLYP_JOB_WORKERS), up to POLYP_JOB_EXTERNAL_THREADS other threads at a time get a deque
+/// on their first job and run jobs while they wait, so the main thread takes part in its own fork-join
+/// work. A thread gives its deque back when it exits, with its jobs completed.
+/// Jobs are stored inline in per-thread slots, running them does not allocate.
+class JobSystem
+{
+public:
+    static constexpr uint32_t kQueueCapacity = 1024; // jobs per thread, new jobs run inline while it is full
+    static constexpr size_t   kJobDataSize   = 48;   // bytes of a job's callable
+
+    static JobSystem& get();
+
+    ~JobSystem();
+
+    JobSystem(const JobSystem&)            = delete;
+    JobSystem& operator=(const JobSystem&) = delete;
+
+    /// Threads running jobs: the workers and the calling thread
+    uint32_t threads() const noexcept { return static_cast<uint32_t>(mWorkers.size()) + 1; }
+
+    /// Index of the calling thread's deque, stable for the thread's lifetime, below slots()
+    uint32_t threadIndex();
+
+    uint32_t slots() const noexcept { return static_cast<uint32_t>(mQueues.size()); }
+
+    /// Queues fn() as a child of counter
+    template<typename F>
+    void run(JobCounter& counter, F&& fn)
+    {
+        using Fn = std::decay_t<F>;
+        static_assert(sizeof(Fn) <= kJobDataSize && alignof(Fn) <= alignof(std::max_align_t), "Job callable is too large");
+
+        Job* job = allocate();
+        if (job == nullptr)
+        {
+            fn();
+            return;
+        }
+
+        new (job->data) Fn(std::forward<F>(fn));
+        job->invoke = [](Job& self) {
+            auto& callable = *std::launder(reinterpret_cast<Fn*>(self.data));
+            callable();
+            callable.~Fn();
+        };
+
+        submit(counter, job);
+    }
+
+    /// Runs jobs until the counter's jobs have completed
+    void wait(JobCounter& counter);
+
+    /// Calls fn(begin, end) over [0, count) in ranges of at most grain items and waits for them.
+    /// Ranges are split in halves on demand, so idle threads steal the large ones.
+    template<typename F>
+    void parallelFor(uint32_t count, uint32_t grain, F&& fn)
+    {
+        if (count == 0)
+            return;
+
+        grain = grain == 0 ? 1 : grain;
+
+        if (count <= grain || mWorkers.empty())
+        {
+            for (uint32_t begin = 0; begin < count; begin += grain)
+                fn(begin, std::min(begin + grain, count));
+            return;
+        }
+
+        JobCounter counter;
+        split(counter, &fn, [](void* ctx, uint32_t begin, uint32_t end) { (*static_cast<std::remove_reference_t<F>*>(ctx))(begin, end); },
+              0, count, grain);
+        wait(counter);
+    }
+
+private:
+    using RangeFn = void (*)(void* ctx, uint32_t begin, uint32_t end);
+
+    struct Job
+    {
+        void (*invoke)(Job& self) = nullptr;
+        JobCounter*       counter = nullptr;
+        std::atomic<bool> busy    = false; // the slot holds a job not completed yet
+
+        alignas(std::max_align_t) std::byte data[kJobDataSize];
+    };
+
+    /// Chase-Lev deque of a fixed capacity
+    class Queue
+    {
+    public:
+        bool push(Job* job) noexcept;  // owner only
+        Job* pop() noexcept;           // owner only
+        Job* steal() noexcept;         // any thread
+
+    private:
+        alignas(64) std::atomic<int64_t> mTop    = 0;
+        alignas(64) std::atomic<int64_t> mBottom = 0;
+
+        std::array<std::atomic<Job*>, kQueueCapacity> mJobs = {};
+    };
+
+    struct Slot
+    {
+        Queue                           queue;
+        std::array<Job, kQueueCapacity> jobs;
+        uint32_t                        next = 0; // round-robin job allocation, owner only
+    };
+
+    /// Returns the calling thread's external deque when the thread exits
+    struct ExternalSlot
+    {
+        JobSystem* system = nullptr;
+        uint32_t   index  = 0;
+
+        ~ExternalSlot();
+    };
+
+    JobSystem();
+
+    Job* allocate();
+    void submit(JobCounter& counter, Job* job);
+    void execute(Job* job);
+    Job* find(uint32_t index);
+    void work(uint32_t index);
+    void split(JobCounter& counter, void* ctx, RangeFn fn, uint32_t begin, uint32_t end, uint32_t grain);
+
+    std::vector<std::unique_ptr<Slot>> mQueues;           // workers first, then threads outside the system
+    std::vector<std::thread>           mWorkers;
+    std::atomic<uint32_t>              mExternal  = 0;    // bit i is set while the external deque i is claimed
+    std::atomic<uint32_t>              mSignal    = 0;    // bumped on every submit, sleeping workers wait on it
+    std::atomic<uint32_t>              mSleeping  = 0;
+    std::atomic<bool>                  mStop      = false;
+};
+
+} // namespace polyp
@@ -74,3 +74,32 @@ assert(lhv != rhv);
 #define POLYPDEBUG(...)
 #define POLYPASSERT(...)
 #endif // !DEBUG
+
+#define POLYP_CONCAT_IMPL(lhv, rhv) lhv##rhv
+#define POLYP_CONCAT(lhv, rhv) POLYP_CONCAT_IMPL(lhv, rhv)
+
+#if !defined(POLYP_TRACE_FILE)
+#define POLYP_TRACE_FILE "polyp_trace.json"
+#endif
+
+/// CPU zones, compiled out unless POLYP_ENABLE_TRACING is defined. The name must be a string literal.
+#ifdef POLYP_ENABLE_TRACING
+#include <generic/trace.h>
+#define POLYPTRACE(name)      polyp::trace::Zone POLYP_CONCAT(traceZone, __LINE__){ name }
+#define POLYPTRACEFLUSH(path) polyp::trace::flush(path)
+#else
+#define POLYPTRACE(name)
+#define POLYPTRACEFLUSH(path)
+#endif // POLYP_ENABLE_TRACING
+
+/// Fails the process when the rest of the enclosing scope allocates on the heap and armed is true at
+/// its end. Allocations of the scope's thread and of the threads marked with POLYPALLOCTRACK() are counted.
+/// Compiled out unless POLYP_ENABLE_ALLOC_CHECK is defined.
+#ifdef POLYP_ENABLE_ALLOC_CHECK
+#include <generic/alloc_check.h>
+#define POLYPALLOCCHECK(name, armed) polyp::alloc::Scope POLYP_CONCAT(allocScope, __LINE__){ name, [&]() { return armed; } }
+#define POLYPALLOCTRACK()            polyp::alloc::track()
+#else
+#define POLYPALLOCCHECK(name, armed)
+#define POLYPALLOCTRACK()
+#endif // POLYP_ENABLE_ALLOC_CHECK
@@ -1,5 +1,7 @@
 #include "model_loader.h"
 
+#include <global.h>
+
 #define TINYOBJLOADER_IMPLEMENTATION
 #define TINYOBJLOADER_USE_MAPBOX_EARCUT
 #include <tiny_obj_loader.h>
@@ -10,6 +12,8 @@ namespace polyp {
 
 ModelLoader ModelLoader::load(const std::string& path)
 {
+    POLYPTRACE("Model load");
+
     ModelLoader output;
 
     tinyobj::ObjReader reader;
@@ -56,8 +60,8 @@ ModelLoader ModelLoader::load(const std::string& path)
                 position.z = attrib.vertices[3 * size_t(idx.vertex_index) + 2];
 
                 #define UPDATE_MIN_MAX(dim) do {                   \
-                    min##dim = std::min(min##dim, position.##dim); \
-                    max##dim = std::max(max##dim, position.##dim); \
+                    min##dim = std::min(min##dim, position.dim);   \
+                    max##dim = std::max(max##dim, position.dim);   \
                     } while(false)
 
                 UPDATE_MIN_MAX(x);
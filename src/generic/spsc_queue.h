@@ -0,0 +1,63 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <cstdint>
+
+namespace polyp {
+
+/// Bounded lock-free queue between one producer and one consumer thread. Positions only grow: the
+/// producer writes the head and the consumer the tail, each keeps a stale copy of the other position
+/// and reloads it only when the queue looks full or empty, so the threads rarely share a cache line.
+template <typename T, uint32_t Capacity>
+class SPSCQueue
+{
+    static_assert(Capacity > 0 && (Capacity & (Capacity - 1)) == 0, "Queue capacity must be a power of two");
+
+public:
+    /// Producer only, false when the queue is full
+    bool push(const T& item) noexcept
+    {
+        const auto head = mHead.load(std::memory_order_relaxed);
+
+        if (head - mCachedTail >= Capacity)
+        {
+            mCachedTail = mTail.load(std::memory_order_acquire);
+            if (head - mCachedTail >= Capacity)
+                return false;
+        }
+
+        mItems[head & (Capacity - 1)] = item;
+        mHead.store(head + 1, std::memory_order_release);
+
+        return true;
+    }
+
+    /// Consumer only, false when the queue is empty
+    bool pop(T& item) noexcept
+    {
+        const auto tail = mTail.load(std::memory_order_relaxed);
+
+        if (tail == mCachedHead)
+        {
+            mCachedHead = mHead.load(std::memory_order_acquire);
+            if (tail == mCachedHead)
+                return false;
+        }
+
+        item = mItems[tail & (Capacity - 1)];
+        mTail.store(tail + 1, std::memory_order_release);
+
+        return true;
+    }
+
+private:
+    alignas(64) std::atomic<uint64_t> mHead       = 0;
+    uint64_t                          mCachedTail = 0; // producer's copy of the tail
+    alignas(64) std::atomic<uint64_t> mTail       = 0;
+    uint64_t                          mCachedHead = 0; // consumer's copy of the head
+
+    alignas(64) std::array<T, Capacity> mItems = {};
+};
+
+} // namespace polyp
@@ -0,0 +1,122 @@
+#include "trace.h"
+
+#ifdef POLYP_ENABLE_TRACING
+
+#include <global.h>
+
+#include <mutex>
+#include <cstdio>
+
+namespace polyp {
+namespace trace {
+
+namespace {
+
+/// Owns the buffers of all threads that ever recorded a zone. Buffers are never released,
+/// so events of exited threads are still flushed.
+struct Registry
+{
+    std::mutex                                 mutex;
+    std::vector<std::unique_ptr<ThreadBuffer>> buffers;
+};
+
+Registry& registry()
+{
+    static Registry instance;
+    return instance;
+}
+
+ThreadBuffer& threadBuffer()
+{
+    thread_local ThreadBuffer* buffer = nullptr;
+
+    if (buffer == nullptr)
+    {
+        auto& reg = registry();
+
+        std::lock_guard lock(reg.mutex);
+        reg.buffers.push_back(std::make_unique<ThreadBuffer>());
+
+        buffer      = reg.buffers.back().get();
+        buffer->tid = static_cast<uint32_t>(reg.buffers.size());
+    }
+
+    return *buffer;
+}
+
+} // namespace
+
+uint64_t now() noexcept
+{
+    using namespace std::chrono;
+    return duration_cast<nanoseconds>(steady_clock::now().time_since_epoch()).count();
+}
+
+void record(const char* name, uint64_t begin, uint64_t end) noexcept
+{
+    auto& buffer = threadBuffer();
+
+    const auto head = buffer.head.load(std::memory_order_relaxed);
+    if (head - buffer.tail.load(std::memory_order_acquire) >= ThreadBuffer::kCapacity)
+    {
+        buffer.dropped.fetch_add(1, std::memory_order_relaxed);
+        return;
+    }
+
+    buffer.events[head % ThreadBuffer::kCapacity] = Event{ name, begin, end };
+    buffer.head.store(head + 1, std::memory_order_release);
+}
+
+bool flush(const char* path)
+{
+    FILE* file = std::fopen(path, "w");
+    if (file == nullptr)
+    {
+        POLYPERROR("Failed to open trace file %s", path);
+        return false;
+    }
+
+    auto& reg = registry();
+
+    std::lock_guard lock(reg.mutex);
+
+    std::fprintf(file, "{\"displayTimeUnit\":\"ns\",\"traceEvents\":[\n");
+
+    bool     first   = true;
+    uint64_t count   = 0;
+    uint64_t dropped = 0;
+
+    for (auto& buffer : reg.buffers)
+    {
+        const auto head = buffer->head.load(std::memory_order_acquire);
+        auto       tail = buffer->tail.load(std::memory_order_relaxed);
+
+        for (; tail != head; ++tail, ++count)
+        {
+            const auto& event = buffer->events[tail % ThreadBuffer::kCapacity];
+
+            // Chrome expects microseconds, the fraction keeps the nanosecond resolution
+            std::fprintf(file, "%s{\"name\":\"%s\",\"ph\":\"X\",\"pid\":1,\"tid\":%u,\"ts\":%.3f,\"dur\":%.3f}",
+                         first ? "" : ",\n", event.name, buffer->tid,
+                         event.begin / 1000.0, (event.end - event.begin) / 1000.0);
+            first = false;
+        }
+
+        buffer->tail.store(tail, std::memory_order_release);
+        dropped += buffer->dropped.exchange(0, std::memory_order_relaxed);
+    }
+
+    std::fprintf(file, "\n]}\n");
+    std::fclose(file);
+
+    POLYPINFO("%llu trace events are written to %s", static_cast<unsigned long long>(count), path);
+    if (dropped > 0)
+        POLYPWARN("%llu trace events are dropped, flush the trace more often", static_cast<unsigned long long>(dropped));
+
+    return true;
+}
+
+} // namespace trace
+} // namespace polyp
+
+#endif // POLYP_ENABLE_TRACING
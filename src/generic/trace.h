@@ -0,0 +1,61 @@
+#pragma once
+
+#include <atomic>
+#include <array>
+#include <cstdint>
+
+namespace polyp {
+namespace trace {
+
+/// Completed CPU zone, timestamps are in nanoseconds of the steady clock
+struct Event
+{
+    const char* name  = nullptr; // must have static storage duration (a string literal)
+    uint64_t    begin = 0;
+    uint64_t    end   = 0;
+};
+
+/// Single producer, single consumer ring owned by one thread.
+/// The owner thread pushes, flush() pops; events are dropped while the ring is full.
+struct ThreadBuffer
+{
+    static constexpr uint32_t kCapacity = 1 << 16;
+
+    std::array<Event, kCapacity> events  = {};
+    std::atomic<uint64_t>        head    = 0; // written by the owner thread only
+    std::atomic<uint64_t>        tail    = 0; // written by the flushing thread only
+    std::atomic<uint64_t>        dropped = 0;
+    uint32_t                     tid     = 0;
+};
+
+uint64_t now() noexcept;
+
+/// Records a completed zone into the calling thread's buffer, never blocks after the thread's first event
+void record(const char* name, uint64_t begin, uint64_t end) noexcept;
+
+/// Drains all thread buffers into a Chrome trace-event JSON file (chrome://tracing, Perfetto)
+bool flush(const char* path);
+
+/// Records the time between its construction and destruction
+class Zone
+{
+public:
+    Zone(const char* name) noexcept :
+        mName(name), mBegin(now())
+    { }
+
+    ~Zone()
+    {
+        record(mName, mBegin, now());
+    }
+
+    Zone(const Zone&)            = delete;
+    Zone& operator=(const Zone&) = delete;
+
+private:
+    const char* mName;
+    uint64_t    mBegin;
+};
+
+} // namespace trace
+} // namespace polyp
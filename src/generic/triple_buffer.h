@@ -0,0 +1,56 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <cstdint>
+
+namespace polyp {
+
+/// Latest-value channel from one writer to one reader thread. The writer fills its back slot and swaps
+/// it with the middle one, the reader swaps the middle slot with its front slot when the middle is newer.
+/// Neither side waits: the reader always owns a complete value, the newest published or the one before.
+template <typename T>
+class TripleBuffer
+{
+public:
+    explicit TripleBuffer(const T& initial) :
+        mSlots{ initial, initial, initial }
+    { }
+
+    TripleBuffer(const TripleBuffer&)            = delete;
+    TripleBuffer& operator=(const TripleBuffer&) = delete;
+
+    /// Writer only, the slot to fill before publish()
+    T& back() noexcept { return mSlots[mBack]; }
+
+    /// Writer only, hands the back slot to the reader and takes a free one
+    void publish() noexcept
+    {
+        mBack = mMiddle.exchange(mBack | kFresh, std::memory_order_acq_rel) & kIndex;
+    }
+
+    /// Reader only, takes the newest published value if there is one the reader has not seen
+    bool update() noexcept
+    {
+        if ((mMiddle.load(std::memory_order_relaxed) & kFresh) == 0)
+            return false;
+
+        mFront = mMiddle.exchange(mFront, std::memory_order_acq_rel) & kIndex;
+        return true;
+    }
+
+    /// Reader only
+    const T& front() const noexcept { return mSlots[mFront]; }
+
+private:
+    static constexpr uint8_t kIndex = 0x3;
+    static constexpr uint8_t kFresh = 0x4; // the middle slot holds a value the reader has not taken
+
+    std::array<T, 3> mSlots;
+
+    alignas(64) std::atomic<uint8_t> mMiddle = 1;
+    alignas(64) uint8_t              mBack   = 0; // writer's slot
+    alignas(64) uint8_t              mFront  = 2; // reader's slot
+};
+
+} // namespace polyp
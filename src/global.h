@@ -17,6 +17,7 @@
 #include <iterator>
 #include <type_traits>
 #include <thread>
+#include <atomic>
 
 #ifndef ENGINE_MAJOR_VERSION
 #define ENGINE_MAJOR_VERSION 1
@@ -64,10 +65,106 @@
 #define POLYP_WIN_APP_NAME "Polyp"
 #endif
 
+#ifndef POLYP_PIPELINE_CACHE_PREFIX
+#define POLYP_PIPELINE_CACHE_PREFIX "pipeline_cache_"
+#endif // !POLYP_PIPELINE_CACHE_PREFIX
+
+#ifndef POLYP_STAGING_SIZE
+#define POLYP_STAGING_SIZE (64ULL << 20)
+#endif // !POLYP_STAGING_SIZE
+
+#ifndef POLYP_UNIFORM_FRAME_SIZE
+#define POLYP_UNIFORM_FRAME_SIZE (256ULL << 10)
+#endif // !POLYP_UNIFORM_FRAME_SIZE
+
+#ifndef POLYP_GEOMETRY_VERTICES
+#define POLYP_GEOMETRY_VERTICES (1u << 20)
+#endif // !POLYP_GEOMETRY_VERTICES
+
+#ifndef POLYP_GEOMETRY_INDICES
+#define POLYP_GEOMETRY_INDICES (4u << 20)
+#endif // !POLYP_GEOMETRY_INDICES
+
+#ifndef POLYP_DEFRAG_BYTES_PER_FRAME
+#define POLYP_DEFRAG_BYTES_PER_FRAME (8ULL << 20)
+#endif // !POLYP_DEFRAG_BYTES_PER_FRAME
+
+#ifndef POLYP_DEFRAG_MOVES_PER_FRAME
+#define POLYP_DEFRAG_MOVES_PER_FRAME 32
+#endif // !POLYP_DEFRAG_MOVES_PER_FRAME
+
+#ifndef POLYP_DEFRAG_CHECK_FRAMES
+#define POLYP_DEFRAG_CHECK_FRAMES 300 // fragmentation check period in frames, 0 turns it off
+#endif // !POLYP_DEFRAG_CHECK_FRAMES
+
+#ifndef POLYP_CULLING_MIN_PIXELS
+#define POLYP_CULLING_MIN_PIXELS 1.0f // objects projected to a smaller diameter are culled
+#endif // !POLYP_CULLING_MIN_PIXELS
+
+#ifndef POLYP_CULLING_REPORT_FRAMES
+#define POLYP_CULLING_REPORT_FRAMES 0 // culling stats period in frames, 0 turns it off
+#endif // !POLYP_CULLING_REPORT_FRAMES
+
+#ifndef POLYP_CPU_CULLING_PARALLEL
+#define POLYP_CPU_CULLING_PARALLEL 65536 // bounding spheres per CPU culling job
+#endif // !POLYP_CPU_CULLING_PARALLEL
+
+#ifndef POLYP_JOB_WORKERS
+#define POLYP_JOB_WORKERS 0 // job system worker threads, 0 takes the hardware threads but one, overridden by the environment
+#endif // !POLYP_JOB_WORKERS
+
+#ifndef POLYP_JOB_EXTERNAL_THREADS
+#define POLYP_JOB_EXTERNAL_THREADS 4 // threads outside the job system that may submit jobs
+#endif // !POLYP_JOB_EXTERNAL_THREADS
+
+#ifndef POLYP_RECORD_THREADS
+#define POLYP_RECORD_THREADS 4 // secondary command buffers recorded at once on the job system, 1 records inline
+#endif // !POLYP_RECORD_THREADS
+
+#ifndef POLYP_RECORD_MIN_ITEMS
+#define POLYP_RECORD_MIN_ITEMS 256 // draws a recording thread takes at least, fewer are not worth a secondary
+#endif // !POLYP_RECORD_MIN_ITEMS
+
+#ifndef POLYP_DRAW_PER_OBJECT
+#define POLYP_DRAW_PER_OBJECT false // samples draw each instance with its own draw call, recorded on POLYP_RECORD_THREADS threads
+#endif // !POLYP_DRAW_PER_OBJECT
+
+#ifndef POLYP_RECORD_ONCE
+#define POLYP_RECORD_ONCE true // samples replay recorded render pass content until something invalidates it
+#endif // !POLYP_RECORD_ONCE
+
+#ifndef POLYP_PIPELINED
+#define POLYP_PIPELINED false // camera updates run on a simulation thread, overlapping the recording of the previous frame
+#endif // !POLYP_PIPELINED
+
+#ifndef POLYP_ALLOC_CHECK_WARMUP_FRAMES
+#define POLYP_ALLOC_CHECK_WARMUP_FRAMES 64 // frames the allocation check skips after the start, a resize or a defragmentation
+#endif // !POLYP_ALLOC_CHECK_WARMUP_FRAMES
+
+#ifndef POLYP_MEMORY_REPORT_FRAMES
+#define POLYP_MEMORY_REPORT_FRAMES 0 // memory report period in frames, 0 turns it off
+#endif // !POLYP_MEMORY_REPORT_FRAMES
+
+#ifndef POLYP_INPUT_QUEUE_SIZE
+#define POLYP_INPUT_QUEUE_SIZE 1024 // input events buffered between the window pump and the frame loop, a power of two
+#endif // !POLYP_INPUT_QUEUE_SIZE
+
+#ifndef POLYP_HEADLESS_FRAMES
+#define POLYP_HEADLESS_FRAMES 1000
+#endif // !POLYP_HEADLESS_FRAMES
+
+#ifndef WIN32
+/// Platforms without a window system are rendered offscreen, the window handles are always empty
+using HWND      = void*;
+using HINSTANCE = void*;
+#endif // !WIN32
+
 namespace polyp {
 namespace constants {
 /// Vulkan constants
 inline constexpr auto      kFenceTimeout            = 2'000'000'000ULL;
+inline constexpr uint32_t  kOffscreenWidth          = 1024;
+inline constexpr uint32_t  kOffscreenHeight         = 600;
 
 /// Default camera values
 inline constexpr float     kSensitivity             = 50.f;
@@ -3,9 +3,45 @@
 #include "vk_common.h"
 #include "vk_context.h"
 
+#include <sstream>
+#include <iomanip>
+
 namespace polyp {
 namespace vulkan {
 
+namespace {
+
+MemoryCategory categorize(vk::BufferUsageFlags usage)
+{
+    if (usage & vk::BufferUsageFlagBits::eVertexBuffer)
+        return MemoryCategory::Vertex;
+    if (usage & vk::BufferUsageFlagBits::eIndexBuffer)
+        return MemoryCategory::Index;
+    if (usage & vk::BufferUsageFlagBits::eUniformBuffer)
+        return MemoryCategory::Uniform;
+    if (usage & vk::BufferUsageFlagBits::eTransferSrc)
+        return MemoryCategory::Staging;
+
+    return MemoryCategory::Other;
+}
+
+MemoryCategory categorize(vk::ImageUsageFlags usage)
+{
+    if (usage & (vk::ImageUsageFlagBits::eColorAttachment | vk::ImageUsageFlagBits::eDepthStencilAttachment))
+        return MemoryCategory::Attachment;
+
+    return MemoryCategory::Other;
+}
+
+const char* toString(MemoryCategory category)
+{
+    const char* names[] = { "other", "vertex", "index", "uniform", "attachment", "staging" };
+
+    return names[static_cast<size_t>(category)];
+}
+
+} // namespace
+
 std::vector<PhysicalDevice> Instance::enumeratePhysicalDevicesPLP() const
 {
     auto gpus = enumeratePhysicalDevices();
@@ -165,10 +201,16 @@ Image::~Image()
 {
     if (mAllocationVMA != VK_NULL_HANDLE)
     {
-        auto resource  = release();
-        auto allocator = RHIContext::get().device().vmaAlocator();
-
-        vmaDestroyImage(allocator, static_cast<VkImage>(resource), mAllocationVMA);
+        auto resource   = static_cast<VkImage>(release());
+        auto allocation = mAllocationVMA;
+        auto category   = mCategory;
+        auto size       = mAllocationVMAInfo.size;
+
+        RHIContext::get().retireCallback([resource, allocation, category, size]() {
+            const auto& device = RHIContext::get().device();
+            vmaDestroyImage(device.vmaAlocator(), resource, allocation);
+            device.track(category, size, false);
+        });
     }
 }
 
@@ -183,7 +225,12 @@ Image Device::createImagePLP(const ImageCreateInfo& createInfo, const VmaAllocat
     if (res != VK_SUCCESS)
         detail::throwResultException(static_cast<vk::Result>(res), __FUNCTION__);
 
-    return Image(*this, *reinterpret_cast<VkImage*>(&resource), allocation, allocationInfo);
+    Image image(*this, *reinterpret_cast<VkImage*>(&resource), allocation, allocationInfo);
+    image.mCategory = categorize(createInfo.usage);
+
+    track(image.mCategory, allocationInfo.size, true);
+
+    return image;
 }
 
 Buffer Device::createBufferPLP(const BufferCreateInfo& createInfo, const VmaAllocationCreateInfo& allocationCreateInfo) const
@@ -198,7 +245,15 @@ Buffer Device::createBufferPLP(const BufferCreateInfo& createInfo, const VmaAllo
     if (res != VK_SUCCESS)
         detail::throwResultException(static_cast<vk::Result>(res), __FUNCTION__);
 
-    return Buffer(*this, *reinterpret_cast<VkBuffer*>(&resource), allocation, allocationInfo);
+    Buffer buffer(*this, *reinterpret_cast<VkBuffer*>(&resource), allocation, allocationInfo);
+    buffer.mCategory = categorize(createInfo.usage);
+    buffer.mSize     = createInfo.size;
+    buffer.mUsage    = createInfo.usage;
+    buffer.updateUserData();
+
+    track(buffer.mCategory, allocationInfo.size, true);
+
+    return buffer;
 }
 
 Swapchain Device::createSwapchainPLP(SwapchainCreateInfoKHR const& createInfo) const
@@ -235,17 +290,147 @@ void Device::init(vk::raii::PhysicalDevice const& gpu)
     }
 }
 
+void Device::track(MemoryCategory category, VkDeviceSize size, bool allocated) const
+{
+    const auto idx = static_cast<size_t>(category);
+
+    if (allocated)
+    {
+        mTelemetry->count[idx].fetch_add(1, std::memory_order_relaxed);
+        mTelemetry->bytes[idx].fetch_add(size, std::memory_order_relaxed);
+    }
+    else
+    {
+        mTelemetry->count[idx].fetch_sub(1, std::memory_order_relaxed);
+        mTelemetry->bytes[idx].fetch_sub(size, std::memory_order_relaxed);
+    }
+}
+
+std::vector<Device::HeapBudget> Device::getHeapBudgetsPLP() const
+{
+    const VkPhysicalDeviceMemoryProperties* memProps = nullptr;
+    vmaGetMemoryProperties(mAllocatorVMA, &memProps);
+
+    std::array<VmaBudget, VK_MAX_MEMORY_HEAPS> budgets{};
+    vmaGetHeapBudgets(mAllocatorVMA, budgets.data());
+
+    std::vector<HeapBudget> output(memProps->memoryHeapCount);
+
+    for (uint32_t i = 0; i < memProps->memoryHeapCount; ++i)
+    {
+        output[i].budget      = budgets[i].budget;
+        output[i].usage       = budgets[i].usage;
+        output[i].blockBytes  = budgets[i].statistics.blockBytes;
+        output[i].allocBytes  = budgets[i].statistics.allocationBytes;
+        output[i].deviceLocal = (memProps->memoryHeaps[i].flags & VK_MEMORY_HEAP_DEVICE_LOCAL_BIT) != 0;
+    }
+
+    return output;
+}
+
+Device::CategoriesStats Device::getCategoriesStatsPLP() const
+{
+    CategoriesStats output{};
+
+    for (size_t i = 0; i < output.size(); ++i)
+    {
+        output[i].count = mTelemetry->count[i].load(std::memory_order_relaxed);
+        output[i].bytes = mTelemetry->bytes[i].load(std::memory_order_relaxed);
+    }
+
+    return output;
+}
+
+std::string Device::getMemoryReportPLP() const
+{
+    constexpr double kMb = 1024. * 1024.;
+
+    std::stringstream ss;
+    ss << std::fixed << std::setprecision(1);
+
+    const auto budgets = getHeapBudgetsPLP();
+    for (size_t i = 0; i < budgets.size(); ++i)
+    {
+        const auto& heap = budgets[i];
+
+        // Unused space in the VMA blocks, grows with fragmentation
+        const auto slack = heap.blockBytes - heap.allocBytes;
+
+        ss << "heap " << i << (heap.deviceLocal ? " (device local)" : "") << ": "
+           << heap.usage / kMb << "/" << heap.budget / kMb << " Mb, slack " << slack / kMb << " Mb; ";
+    }
+
+    const auto stats = getCategoriesStatsPLP();
+    for (size_t i = 0; i < stats.size(); ++i)
+    {
+        if (stats[i].count == 0)
+            continue;
+
+        ss << toString(static_cast<MemoryCategory>(i)) << ": " << stats[i].count << " allocs "
+           << stats[i].bytes / kMb << " Mb; ";
+    }
+
+    return ss.str();
+}
+
+std::string Device::buildStatsStringPLP(bool detailedMap) const
+{
+    char* stats = nullptr;
+    vmaBuildStatsString(mAllocatorVMA, &stats, detailedMap ? VK_TRUE : VK_FALSE);
+
+    std::string output = stats != nullptr ? stats : "";
+    vmaFreeStatsString(mAllocatorVMA, stats);
+
+    return output;
+}
+
 Buffer::~Buffer()
 {
     if (mAllocationVMA != VK_NULL_HANDLE)
     {
-        auto resource  = release();
-        auto allocator = RHIContext::get().device().vmaAlocator();
+        auto resource   = static_cast<VkBuffer>(release());
+        auto allocation = mAllocationVMA;
+        auto category   = mCategory;
+        auto size       = mAllocationVMAInfo.size;
 
-        vmaDestroyBuffer(allocator, static_cast<VkBuffer>(resource), mAllocationVMA);
+        if (mMoving)
+        {
+            // The allocation is freed by the defragmentation pass, which finds it orphaned
+            vmaSetAllocationUserData(RHIContext::get().device().vmaAlocator(), allocation, nullptr);
+
+            RHIContext::get().retireCallback([resource, category, size]() {
+                const auto& device = RHIContext::get().device();
+                device.getDispatcher()->vkDestroyBuffer(static_cast<VkDevice>(*device), resource, nullptr);
+                device.track(category, size, false);
+            });
+
+            return;
+        }
+
+        RHIContext::get().retireCallback([resource, allocation, category, size]() {
+            const auto& device = RHIContext::get().device();
+            vmaDestroyBuffer(device.vmaAlocator(), resource, allocation);
+            device.track(category, size, false);
+        });
     }
 }
 
+void Buffer::invalidate(VkDeviceSize offset, VkDeviceSize size) const
+{
+    auto allocator = RHIContext::get().device().vmaAlocator();
+
+    auto res = vmaInvalidateAllocation(allocator, mAllocationVMA, offset, size);
+
+    if (res != VK_SUCCESS)
+        detail::throwResultException(static_cast<vk::Result>(res), __FUNCTION__);
+}
+
+void Buffer::updateUserData() noexcept
+{
+    if (mAllocationVMA != VK_NULL_HANDLE)
+        vmaSetAllocationUserData(RHIContext::get().device().vmaAlocator(), mAllocationVMA, this);
+}
+
 void Buffer::fill(void* data, VkDeviceSize size, VkDeviceSize offset)
 {
     auto& device = RHIContext::get().device();
@@ -257,5 +442,15 @@ void Buffer::fill(void* data, VkDeviceSize size, VkDeviceSize offset)
         detail::throwResultException(static_cast<vk::Result>(res), __FUNCTION__);
 }
 
+void Buffer::flush(VkDeviceSize offset, VkDeviceSize size) const
+{
+    auto allocator = RHIContext::get().device().vmaAlocator();
+
+    auto res = vmaFlushAllocation(allocator, mAllocationVMA, offset, size);
+
+    if (res != VK_SUCCESS)
+        detail::throwResultException(static_cast<vk::Result>(res), __FUNCTION__);
+}
+
 }
 }
\ No newline at end of file
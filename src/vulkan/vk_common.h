@@ -30,6 +30,20 @@ using PipelineLayout      = vk::raii::PipelineLayout;
 using DescriptorPool      = vk::raii::DescriptorPool;
 using DescriptorSet       = vk::raii::DescriptorSet;
 using ShaderModule        = vk::raii::ShaderModule;
+using QueryPool           = vk::raii::QueryPool;
+using PipelineCache       = vk::raii::PipelineCache;
+
+/// Allocation categories of the memory telemetry, derived from the resource usage flags
+enum class MemoryCategory : uint32_t
+{
+    Other,
+    Vertex,
+    Index,
+    Uniform,
+    Attachment,
+    Staging,
+    Count,
+};
 
 class PhysicalDevice;
 class Instance;
@@ -122,6 +136,7 @@ public:
         vk::raii::Device(static_cast<vk::raii::Device&&>(rhv))
     {
         std::swap(mAllocatorVMA, rhv.mAllocatorVMA);
+        std::swap(mTelemetry,    rhv.mTelemetry);
     }
 
     Device& operator=(Device&& rhv) noexcept
@@ -129,6 +144,7 @@ public:
         vk::raii::Device::operator=(static_cast<vk::raii::Device&&>(rhv));
 
         std::swap(mAllocatorVMA, rhv.mAllocatorVMA);
+        std::swap(mTelemetry,    rhv.mTelemetry);
 
         return *this;
     }
@@ -146,10 +162,50 @@ public:
 
     Swapchain createSwapchainPLP(SwapchainCreateInfoKHR const& createInfo) const;
 
+    struct HeapBudget
+    {
+        VkDeviceSize     budget = 0; // estimated bytes available to the process
+        VkDeviceSize      usage = 0; // bytes used by the process, including other APIs
+        VkDeviceSize blockBytes = 0; // bytes allocated by VMA
+        VkDeviceSize allocBytes = 0; // bytes occupied by allocations inside the VMA blocks
+        bool        deviceLocal = false;
+    };
+
+    struct CategoryStats
+    {
+        uint64_t     count = 0;
+        VkDeviceSize bytes = 0;
+    };
+
+    using CategoriesStats = std::array<CategoryStats, static_cast<size_t>(MemoryCategory::Count)>;
+
+    /// Per-heap budget and usage, VK_EXT_memory_budget data if available
+    std::vector<HeapBudget> getHeapBudgetsPLP() const;
+
+    /// Live allocations made through createImagePLP/createBufferPLP
+    CategoriesStats getCategoriesStatsPLP() const;
+
+    /// Human readable budget and category summary
+    std::string getMemoryReportPLP() const;
+
+    /// VMA JSON statistics, detailed map includes every allocation
+    std::string buildStatsStringPLP(bool detailedMap) const;
+
 private:
-    VmaAllocator mAllocatorVMA = { VK_NULL_HANDLE };
+    friend class Image;
+    friend class Buffer;
+
+    struct Telemetry
+    {
+        std::array<std::atomic<uint64_t>, static_cast<size_t>(MemoryCategory::Count)> count = {};
+        std::array<std::atomic<uint64_t>, static_cast<size_t>(MemoryCategory::Count)> bytes = {};
+    };
+
+    VmaAllocator               mAllocatorVMA = { VK_NULL_HANDLE };
+    std::unique_ptr<Telemetry> mTelemetry    = std::make_unique<Telemetry>();
 
     void init(vk::raii::PhysicalDevice const& gpu);
+    void track(MemoryCategory category, VkDeviceSize size, bool allocated) const;
 };
 
 class Swapchain : public vk::raii::SwapchainKHR
@@ -216,6 +272,7 @@ public:
     {
         std::swap(mAllocationVMA,     rhv.mAllocationVMA);
         std::swap(mAllocationVMAInfo, rhv.mAllocationVMAInfo);
+        std::swap(mCategory,          rhv.mCategory);
     }
 
     Image& operator=(Image&& rhv) noexcept
@@ -224,6 +281,7 @@ public:
 
         std::swap(mAllocationVMA,     rhv.mAllocationVMA);
         std::swap(mAllocationVMAInfo, rhv.mAllocationVMAInfo);
+        std::swap(mCategory,          rhv.mCategory);
 
         return *this;
     }
@@ -249,12 +307,14 @@ private:
 
     VmaAllocation         mAllocationVMA = VK_NULL_HANDLE;
     VmaAllocationInfo mAllocationVMAInfo = {};
+    MemoryCategory             mCategory = MemoryCategory::Other;
 };
 
 class Buffer : protected vk::raii::Buffer
 {
 public:
     friend class Device;
+    friend class Defragmenter;
 
     Buffer(std::nullptr_t ptr) :
         vk::raii::Buffer(ptr)
@@ -269,6 +329,13 @@ public:
     {
         std::swap(mAllocationVMA,     rhv.mAllocationVMA);
         std::swap(mAllocationVMAInfo, rhv.mAllocationVMAInfo);
+        std::swap(mCategory,          rhv.mCategory);
+        std::swap(mSize,              rhv.mSize);
+        std::swap(mUsage,             rhv.mUsage);
+        std::swap(mMovable,           rhv.mMovable);
+        std::swap(mMoving,            rhv.mMoving);
+
+        updateUserData();
     }
 
     Buffer& operator=(Buffer&& rhv) noexcept
@@ -277,6 +344,14 @@ public:
 
         std::swap(mAllocationVMA,     rhv.mAllocationVMA);
         std::swap(mAllocationVMAInfo, rhv.mAllocationVMAInfo);
+        std::swap(mCategory,          rhv.mCategory);
+        std::swap(mSize,              rhv.mSize);
+        std::swap(mUsage,             rhv.mUsage);
+        std::swap(mMovable,           rhv.mMovable);
+        std::swap(mMoving,            rhv.mMoving);
+
+        updateUserData();
+        rhv.updateUserData();
 
         return *this;
     }
@@ -290,6 +365,20 @@ public:
 
     void fill(void* data, VkDeviceSize size, VkDeviceSize offset = 0);
 
+    /// Host pointer of a persistently mapped buffer (VMA_ALLOCATION_CREATE_MAPPED_BIT), nullptr otherwise
+    void* mappedData() const noexcept { return mAllocationVMAInfo.pMappedData; }
+
+    /// Makes host writes visible to the device, no-op for coherent memory
+    void flush(VkDeviceSize offset, VkDeviceSize size) const;
+
+    /// Makes device writes visible to the host, no-op for coherent memory
+    void invalidate(VkDeviceSize offset, VkDeviceSize size) const;
+
+    /// Allows the defragmenter to move the buffer to another memory location. The VkBuffer handle
+    /// changes on a move, so only buffers which are bound at record time and aren't referenced by
+    /// descriptor sets or kept mapped may be movable.
+    void setMovable(bool movable) noexcept { mMovable = movable; }
+
     template<typename Container>
     void fill(const Container& data, VkDeviceSize offset = 0)
     {
@@ -309,8 +398,16 @@ private:
         mAllocationVMAInfo = vmaAllocationInfo;
     }
 
+    /// Points the VMA allocation user data to this object, the defragmenter finds buffers by it
+    void updateUserData() noexcept;
+
     VmaAllocation         mAllocationVMA = VK_NULL_HANDLE;
     VmaAllocationInfo mAllocationVMAInfo = {};
+    MemoryCategory             mCategory = MemoryCategory::Other;
+    VkDeviceSize                   mSize = 0;
+    vk::BufferUsageFlags          mUsage = {};
+    bool                        mMovable = false;
+    bool                         mMoving = false; // the allocation belongs to a running defragmentation pass
 };
 
 }
@@ -1,6 +1,11 @@
 #include "vk_context.h"
 #include "vk_utils.h"
 
+#include <fstream>
+#include <filesystem>
+#include <sstream>
+#include <iomanip>
+
 using namespace polyp::vulkan::utils;
 
 namespace polyp {
@@ -47,11 +52,15 @@ void RHIContext::init(const CreateInfo::Application& info)
 
     ApplicationInfo applicationInfo(info.name.c_str(), info.version, ENGINE_NAME, ENGINE_VERSION, ENGINE_VK_VERSION);
 
-    std::vector<const char*> extensions
+    std::vector<const char*> extensions{};
+
+#if defined(VK_USE_PLATFORM_WIN32_KHR)
+    if (!mHeadless)
     {
-        VK_KHR_SURFACE_EXTENSION_NAME,
-        VK_KHR_WIN32_SURFACE_EXTENSION_NAME
-    };
+        extensions.push_back(VK_KHR_SURFACE_EXTENSION_NAME);
+        extensions.push_back(VK_KHR_WIN32_SURFACE_EXTENSION_NAME);
+    }
+#endif
 
     std::vector<const char*> layers{};
 
@@ -94,12 +103,16 @@ void RHIContext::init(const CreateInfo::Surface& info)
 
     if (info.handle == NULL || info.instance == NULL)
     {
-        POLYPERROR("Empty surface info provided. WSI will no be created.");
+        POLYPINFO("Empty surface info provided. WSI will no be created, rendering goes offscreen.");
         return;
     }
 
+#if defined(VK_USE_PLATFORM_WIN32_KHR)
     Win32SurfaceCreateInfoKHR surfaceInfo({}, info.instance, info.handle, nullptr);
     mSurface = mInstance.createWin32SurfaceKHR(surfaceInfo);
+#else
+    POLYPERROR("WSI is not supported on this platform.");
+#endif
 }
 
 void RHIContext::init(const CreateInfo::Device& info)
@@ -120,7 +133,8 @@ void RHIContext::init(const CreateInfo::Device& info)
 
     auto queProps = mGPU.getQueueFamilyProperties();
 
-    auto availableWSIQueue = getSupportedQueueFamilies(mGPU, mSurface);
+    auto availableWSIQueue = mHeadless ? std::vector<bool>(queProps.size(), true) :
+                                         getSupportedQueueFamilies(mGPU, mSurface);
 
     std::vector<std::vector<float>> quePriorities(info.queues.size());
 
@@ -142,7 +156,7 @@ void RHIContext::init(const CreateInfo::Device& info)
         {
             if (availableQueue[j] && queProps[j].queueCount >= queInfo.count)
             {
-                if (queInfo.isWSIRequred && availableWSIQueue[i])
+                if (queInfo.isWSIRequred && availableWSIQueue[j])
                 {
                     queueCreateInfos[i].queueFamilyIndex = j;
                     queProps[j].queueCount -= queInfo.count;
@@ -170,12 +184,55 @@ void RHIContext::init(const CreateInfo::Device& info)
         }
 
         mQueueFamilies[queInfo.flags] = queueCreateInfos[i].queueFamilyIndex;
+
+        if (mGraphicsFamily == UINT32_MAX && (queInfo.flags & QueueFlagBits::eGraphics))
+            mGraphicsFamily = queueCreateInfos[i].queueFamilyIndex;
     }
 
-    std::vector<const char*> extansions = { VK_KHR_SWAPCHAIN_EXTENSION_NAME };
+    if (mGraphicsFamily == UINT32_MAX)
+    {
+        POLYPERROR("None of the requested queues supports graphics");
+        return;
+    }
 
-    deviceCreateInfo.ppEnabledExtensionNames = extansions.data();
-    deviceCreateInfo.enabledExtensionCount   = extansions.size();
+    // A transfer-only family (a DMA engine) lets uploads run alongside rendering.
+    // Without one the transfers share the graphics queue.
+    mTransfer.family    = mGraphicsFamily;
+    mTransfer.dedicated = false;
+
+    for (uint32_t j = 0; j < queProps.size(); ++j)
+    {
+        const auto flags = queProps[j].queueFlags;
+
+        const bool used = std::any_of(queueCreateInfos.begin(), queueCreateInfos.end(), [j](const auto& createInfo) {
+            return createInfo.queueFamilyIndex == j;
+        });
+
+        if (!used && queProps[j].queueCount > 0 && (flags & QueueFlagBits::eTransfer) &&
+            !(flags & (QueueFlagBits::eGraphics | QueueFlagBits::eCompute)))
+        {
+            quePriorities.push_back({ 1. });
+
+            DeviceQueueCreateInfo transferCreateInfo{};
+            transferCreateInfo.queueFamilyIndex = j;
+            transferCreateInfo.queueCount       = 1;
+            transferCreateInfo.pQueuePriorities = quePriorities.back().data();
+
+            queueCreateInfos.push_back(transferCreateInfo);
+
+            deviceCreateInfo.pQueueCreateInfos    = queueCreateInfos.data();
+            deviceCreateInfo.queueCreateInfoCount = queueCreateInfos.size();
+
+            mTransfer.family    = j;
+            mTransfer.dedicated = true;
+            break;
+        }
+    }
+
+    std::vector<const char*> extansions{};
+
+    if (!mHeadless)
+        extansions.push_back(VK_KHR_SWAPCHAIN_EXTENSION_NAME);
 
     {
         auto available = mGPU.enumerateDeviceExtensionProperties();
@@ -205,6 +262,9 @@ void RHIContext::init(const CreateInfo::Device& info)
         }
     }
 
+    deviceCreateInfo.ppEnabledExtensionNames = extansions.data();
+    deviceCreateInfo.enabledExtensionCount   = extansions.size();
+
     PhysicalDeviceFeatures deviceFeatures = info.features;
     deviceCreateInfo.pEnabledFeatures     = &deviceFeatures;
 
@@ -227,19 +287,88 @@ void RHIContext::init(const CreateInfo::Device& info)
         }
     }
 
+    // GPU-driven draws need the draw count to come from a buffer and many draws per indirect call
+    auto supported12 = mGPU.getFeatures2<vk::PhysicalDeviceFeatures2, PhysicalDeviceVulkan12Features>()
+                           .get<PhysicalDeviceVulkan12Features>();
+
+    mFeatures.drawIndirectCount = supported12.drawIndirectCount && deviceFeatures.multiDrawIndirect;
+
+    PhysicalDeviceVulkan12Features features12{};
+    features12.timelineSemaphore = vk::True;
+    features12.hostQueryReset    = vk::True;
+    features12.drawIndirectCount = mFeatures.drawIndirectCount ? vk::True : vk::False;
+
+    deviceCreateInfo.pNext = &features12;
+
     auto device = mGPU.createDevice(deviceCreateInfo).release();
     mDevice = Device(static_cast<vk::raii::PhysicalDevice&>(mGPU), device);
+
+    mTimeline = Timeline(mDevice);
+
+    loadPipelineCache();
+
+    mTransfer.queue = mDevice.getQueue(mTransfer.family, 0);
+    mStaging        = StagingRing(*mTransfer.queue, mTransfer.family, mGraphicsFamily, POLYP_STAGING_SIZE);
+    mDefragmenter   = Defragmenter(POLYP_DEFRAG_BYTES_PER_FRAME, POLYP_DEFRAG_MOVES_PER_FRAME);
+
+    if (asyncTransfer())
+        POLYPINFO("Dedicated transfer queue family %u is used for uploads", mTransfer.family);
+
+    if (mHeadless)
+        mOffscreen.queue = mDevice.getQueue(mGraphicsFamily, 0);
 }
 
 void RHIContext::init(const CreateInfo::SwapChain& info)
 {
     mCreateInfo.swapchain = info;
 
+    if (mCreateInfo.swapchain.frames == 0)
+        mCreateInfo.swapchain.frames = 1;
+
+    if (mHeadless)
+    {
+        auto& extent = mCreateInfo.swapchain.extent;
+        if (extent.width == 0 || extent.height == 0)
+            extent = Extent2D{ constants::kOffscreenWidth, constants::kOffscreenHeight };
+
+        // The offscreen extent never changes, so the ring is only built once
+        if (mOffscreen.images.size() == info.count)
+            return;
+
+        mOffscreen.images.clear();
+        mOffscreen.index = 0;
+
+        ImageCreateInfo imCreateInfo{};
+        imCreateInfo.imageType   = vk::ImageType::e2D;
+        imCreateInfo.format      = mOffscreen.format;
+        imCreateInfo.extent      = vk::Extent3D(extent.width, extent.height, 1);
+        imCreateInfo.mipLevels   = 1;
+        imCreateInfo.arrayLayers = 1;
+        imCreateInfo.samples     = vk::SampleCountFlagBits::e1;
+        imCreateInfo.tiling      = vk::ImageTiling::eOptimal;
+        imCreateInfo.usage       = vk::ImageUsageFlagBits::eColorAttachment | vk::ImageUsageFlagBits::eTransferSrc;
+
+        VmaAllocationCreateInfo allocCreateInfo{};
+        allocCreateInfo.usage = VMA_MEMORY_USAGE_AUTO_PREFER_DEVICE;
+        allocCreateInfo.flags = VMA_ALLOCATION_CREATE_DEDICATED_MEMORY_BIT;
+
+        for (uint32_t i = 0; i < info.count; ++i)
+            mOffscreen.images.push_back(mDevice.createImagePLP(imCreateInfo, allocCreateInfo));
+
+        return;
+    }
+
     PresentModeKHR reqPresentMode = PresentModeKHR::eMailbox;
 
     auto surfaceFormat = mGPU.getColorFormatPLP(mSurface);
     auto capabilities  = mGPU.getSurfaceCapabilitiesKHR(*mSurface);
 
+    if (capabilities.currentExtent.width == 0 || capabilities.currentExtent.height == 0)
+    {
+        POLYPDEBUG("Zero surface extent, swapchain is not recreated");
+        return;
+    }
+
     SwapchainCreateInfoKHR createInfo{};
     createInfo.surface          = *mSurface;
     createInfo.minImageCount    = info.count;
@@ -269,7 +398,228 @@ void RHIContext::init(const CreateInfo::SwapChain& info)
                    to_string(reqPresentMode).c_str(),
                    to_string(createInfo.presentMode).c_str());
     }
+    // Presents queued for the old swapchain may still be in flight, so it is retired instead of destroyed
+    auto oldSwapchain = std::move(mSwapchain);
     mSwapchain = mDevice.createSwapchainPLP(createInfo);
+    retire(std::move(oldSwapchain));
+
+    // extent() reports the swapchain's extent, so the surface is not queried every frame
+    if (*mSwapchain != VK_NULL_HANDLE)
+        mCreateInfo.swapchain.extent = createInfo.imageExtent;
+}
+
+bool RHIContext::onResize()
+{
+    if (mHeadless)
+        return !mOffscreen.images.empty();
+
+    auto oldSwapchain = *mSwapchain;
+
+    init(mCreateInfo.swapchain);
+
+    return *mSwapchain != VK_NULL_HANDLE && *mSwapchain != oldSwapchain;
+}
+
+void RHIContext::clear()
+{
+    if (*mDevice != VK_NULL_HANDLE)
+        mDevice.waitIdle();
+
+    savePipelineCache();
+
+    mSwapchain.clear();
+    mSurface.clear();
+    mOffscreen.images.clear();
+    mOffscreen.queue.clear();
+    mDefragmenter = nullptr;
+    mStaging = nullptr;
+    mTransfer.queue.clear();
+    mDeletionQueue.flush();
+    mPipelineCache.clear();
+    mTimeline = nullptr;
+    mDevice.clear();
+    mGPU.clear();
+    mInstance.clear();
+    mContext = {};
+}
+
+void RHIContext::loadPipelineCache()
+{
+    const auto props = mGPU.getProperties();
+
+    std::stringstream ss;
+    ss << POLYP_PIPELINE_CACHE_PREFIX << std::hex;
+    for (auto byte : props.pipelineCacheUUID)
+        ss << std::setw(2) << std::setfill('0') << static_cast<uint32_t>(byte);
+    ss << ".bin";
+
+    mPipelineCachePath = ss.str();
+
+    std::vector<char> data;
+
+    std::ifstream is(mPipelineCachePath, std::ios::binary | std::ios::in | std::ios::ate);
+    if (is.is_open())
+    {
+        data.resize(is.tellg());
+        is.seekg(0, std::ios::beg);
+        is.read(data.data(), data.size());
+        is.close();
+    }
+
+    // The driver must reject a foreign blob itself, but not all of them do, so the header is checked here
+    if (!data.empty())
+    {
+        VkPipelineCacheHeaderVersionOne header{};
+        if (data.size() >= sizeof(header))
+            std::memcpy(&header, data.data(), sizeof(header));
+
+        const bool valid = data.size()        >= sizeof(header)                        &&
+                           header.headerSize  >= sizeof(header)                        &&
+                           header.headerVersion == VK_PIPELINE_CACHE_HEADER_VERSION_ONE &&
+                           header.vendorID    == props.vendorID                        &&
+                           header.deviceID    == props.deviceID                        &&
+                           std::memcmp(header.pipelineCacheUUID, props.pipelineCacheUUID.data(), VK_UUID_SIZE) == 0;
+
+        if (!valid)
+        {
+            POLYPWARN("Pipeline cache %s doesn't match the device and is discarded", mPipelineCachePath.c_str());
+            data.clear();
+        }
+    }
+
+    vk::PipelineCacheCreateInfo createInfo{};
+    createInfo.initialDataSize = data.size();
+    createInfo.pInitialData    = data.data();
+
+    mPipelineCache = mDevice.createPipelineCache(createInfo);
+
+    POLYPDEBUG("Pipeline cache %s loaded, %zu bytes", mPipelineCachePath.c_str(), data.size());
+}
+
+void RHIContext::savePipelineCache() const
+{
+    if (*mPipelineCache == VK_NULL_HANDLE)
+        return;
+
+    const auto data = mPipelineCache.getData();
+    if (data.empty())
+        return;
+
+    // Written aside and renamed, so a crash in the middle never leaves a truncated cache behind
+    const auto tmpPath = mPipelineCachePath + ".tmp";
+    {
+        std::ofstream os(tmpPath, std::ios::binary | std::ios::out | std::ios::trunc);
+        os.write(reinterpret_cast<const char*>(data.data()), data.size());
+        os.close();
+
+        if (!os)
+        {
+            POLYPERROR("Failed to write pipeline cache %s", tmpPath.c_str());
+            return;
+        }
+    }
+
+    std::error_code ec;
+    std::filesystem::rename(tmpPath, mPipelineCachePath, ec);
+    if (ec)
+    {
+        POLYPERROR("Failed to save pipeline cache %s: %s", mPipelineCachePath.c_str(), ec.message().c_str());
+        std::filesystem::remove(tmpPath, ec);
+    }
+}
+
+Extent2D RHIContext::extent() const
+{
+    return mCreateInfo.swapchain.extent;
+}
+
+Format RHIContext::colorFormat() const
+{
+    if (mHeadless)
+        return mOffscreen.format;
+
+    return mSwapchain.getImageFormatPLP();
+}
+
+ImageLayout RHIContext::presentLayout() const
+{
+    return mHeadless ? ImageLayout::eTransferSrcOptimal : ImageLayout::ePresentSrcKHR;
+}
+
+std::vector<vk::Image> RHIContext::images() const
+{
+    if (!mHeadless)
+        return mSwapchain.getImages();
+
+    std::vector<vk::Image> output;
+    std::transform(mOffscreen.images.begin(), mOffscreen.images.end(), std::back_inserter(output), [](const auto& image) {
+        return *image;
+    });
+
+    return output;
+}
+
+std::pair<Result, uint32_t> RHIContext::acquireNextImage(uint64_t timeout, vk::Semaphore semaphore, vk::Fence fence)
+{
+    if (!mHeadless)
+    {
+        try
+        {
+            return mSwapchain.acquireNextImage(timeout, semaphore, fence);
+        }
+        catch (const vk::OutOfDateKHRError&)
+        {
+            return std::make_pair(Result::eErrorOutOfDateKHR, UINT32_MAX);
+        }
+    }
+
+    auto index = mOffscreen.index;
+    mOffscreen.index = (mOffscreen.index + 1) % mOffscreen.images.size();
+
+    // Offscreen images are available immediately, an empty batch signals the sync primitives like WSI does
+    if (semaphore || fence)
+    {
+        vk::SubmitInfo submitInfo{};
+        submitInfo.signalSemaphoreCount = semaphore ? 1 : 0;
+        submitInfo.pSignalSemaphores    = &semaphore;
+        mOffscreen.queue.submit(submitInfo, fence);
+    }
+
+    return std::make_pair(Result::eSuccess, index);
+}
+
+Result RHIContext::present(const Queue& queue, const PresentInfoKHR& info)
+{
+    if (!mHeadless)
+    {
+        try
+        {
+            return queue.presentKHR(info);
+        }
+        catch (const vk::OutOfDateKHRError&)
+        {
+            return Result::eErrorOutOfDateKHR;
+        }
+    }
+
+    // Nothing to show, but the wait semaphores have to be unsignaled for the next frame
+    if (info.waitSemaphoreCount > 0)
+    {
+        // Presented every frame, so the stages live on the stack
+        std::array<vk::PipelineStageFlags, 8> stages;
+        if (info.waitSemaphoreCount > stages.size())
+            POLYPFATAL("Offscreen present waits for %u semaphores, %zu at most", info.waitSemaphoreCount, stages.size());
+
+        stages.fill(vk::PipelineStageFlagBits::eAllCommands);
+
+        vk::SubmitInfo submitInfo{};
+        submitInfo.waitSemaphoreCount = info.waitSemaphoreCount;
+        submitInfo.pWaitSemaphores    = info.pWaitSemaphores;
+        submitInfo.pWaitDstStageMask  = stages.data();
+        queue.submit(submitInfo);
+    }
+
+    return Result::eSuccess;
 }
 
 uint32_t RHIContext::queueFamily(QueueFlags flags) const
@@ -288,6 +638,8 @@ void RHIContext::init(const CreateInfo& info)
 {
     clear();
 
+    mHeadless = (info.win.handle == NULL || info.win.instance == NULL);
+
     init(info.app);
     if (*mInstance == VK_NULL_HANDLE)
     {
@@ -303,7 +655,7 @@ void RHIContext::init(const CreateInfo& info)
     }
 
     init(info.win);
-    if (*mSurface == VK_NULL_HANDLE)
+    if (*mSurface == VK_NULL_HANDLE && !mHeadless)
     {
         POLYPERROR("Failed to initialize Vulkan surface (WSI)");
         return;
@@ -317,7 +669,7 @@ void RHIContext::init(const CreateInfo& info)
     }
 
     init(info.swapchain);
-    if (*mSwapchain == VK_NULL_HANDLE)
+    if (*mSwapchain == VK_NULL_HANDLE && mOffscreen.images.empty())
     {
         POLYPERROR("Failed to initialize Vulkan swapchain");
         return;
@@ -1,6 +1,10 @@
 #pragma once
 
 #include "vk_common.h"
+#include "vk_timeline.h"
+#include "vk_deletion_queue.h"
+#include "vk_staging.h"
+#include "vk_defragmenter.h"
 
 #include <string>
 #include <map>
@@ -45,7 +49,9 @@ public:
 
         struct SwapChain
         {
-            uint32_t count; // image count
+            uint32_t  count;       // image count
+            uint32_t frames;       // frames in flight, independent of the image count
+            Extent2D extent = {}; // offscreen image extent, the current swapchain extent with a surface
         } swapchain;
     };
 
@@ -58,14 +64,56 @@ public:
     RHIContext(const RHIContext&)            = delete;
     RHIContext& operator=(const RHIContext&) = delete;
 
+    ~RHIContext() { clear(); }
+
     const Instance&       instance() const { return mInstance; }
     const PhysicalDevice&      gpu() const { return mGPU; }
     const SurfaceKHR&      surface() const { return mSurface; }
     const Device&           device() const { return mDevice; }
     const Swapchain&     swapchain() const { return mSwapchain; }
+    Timeline&             timeline()       { return mTimeline; }
+    StagingRing&           staging()       { return mStaging; }
+    Defragmenter&     defragmenter()       { return mDefragmenter; }
+
+    /// Shared by all pipeline creation, persisted on disk between launches
+    const PipelineCache& pipelineCache() const { return mPipelineCache; }
 
     uint32_t queueFamily(QueueFlags flags) const;
 
+    /// Family of the first requested queue with graphics support, rendering and presentation use its queue 0
+    uint32_t graphicsFamily() const noexcept { return mGraphicsFamily; }
+
+    /// Queue uploads are submitted to. It is a dedicated transfer-only queue if the GPU has one,
+    /// otherwise the queue 0 of the graphics family.
+    const Queue& transferQueue()  const noexcept { return mTransfer.queue; }
+    uint32_t     transferFamily() const noexcept { return mTransfer.family; }
+
+    /// Uploads run on a queue of their own, resources change queue family ownership on the way
+    bool asyncTransfer() const noexcept { return mTransfer.dedicated; }
+
+    uint32_t framesInFlight() const noexcept { return mCreateInfo.swapchain.frames; }
+
+    /// vkCmdDrawIndexedIndirectCount with many draws is available (drawIndirectCount and multiDrawIndirect)
+    bool drawIndirectCount() const noexcept { return mFeatures.drawIndirectCount; }
+
+    /// Surfaceless mode: rendering goes to a ring of offscreen images instead of the swapchain
+    bool headless() const noexcept { return mHeadless; }
+
+    /// Current extent of the presentable images (surface or offscreen ring)
+    Extent2D extent() const;
+
+    /// Format of the presentable images (surface or offscreen ring)
+    Format colorFormat() const;
+
+    /// Layout presentable images have to be transitioned to before present
+    ImageLayout presentLayout() const;
+
+    std::vector<vk::Image> images() const;
+
+    std::pair<Result, uint32_t> acquireNextImage(uint64_t timeout, vk::Semaphore semaphore, vk::Fence fence);
+
+    Result present(const Queue& queue, const PresentInfoKHR& info);
+
     void init(const CreateInfo& info);
     void init(const CreateInfo::Application& info);
     void init(const CreateInfo::GPU info);
@@ -73,37 +121,80 @@ public:
     void init(const CreateInfo::Device& info);
     void init(const CreateInfo::SwapChain& info);
 
-    void clear()
+    void clear();
+
+    /// Destroys the object once the GPU is done with the next submission, the last one which may use it
+    template<typename T>
+    void retire(T&& object)
+    {
+        mDeletionQueue.push(std::forward<T>(object), mTimeline.submitted() + 1);
+    }
+
+    /// The same as retire() for raw handles, the callback releases them
+    template<typename Func>
+    void retireCallback(Func&& callback)
     {
-        mSwapchain.clear();
-        mDevice.clear();
-        mGPU.clear();
-        mInstance.clear();
-        mContext = {};
+        mDeletionQueue.pushCallback(std::forward<Func>(callback), mTimeline.submitted() + 1);
     }
 
+    /// Destroys retired objects whose submissions have been completed. Called once per frame.
+    void collect() { mDeletionQueue.collect(mTimeline.completed()); }
+
     bool ready() const noexcept
     {
         return (*mInstance  != VK_NULL_HANDLE &&
                 *mGPU       != VK_NULL_HANDLE &&
                 *mDevice    != VK_NULL_HANDLE &&
-                *mSwapchain != VK_NULL_HANDLE);
+                (*mSwapchain != VK_NULL_HANDLE || !mOffscreen.images.empty()));
     }
 
-    void onResize() { init(mCreateInfo.swapchain); }
+    /// Recreates the swapchain for the current surface extent, the old one is retired.
+    /// Returns false if there is nothing to present to (e.g. minimized window).
+    bool onResize();
 
 private:
     RHIContext() = default;
 
+    void loadPipelineCache();
+    void savePipelineCache() const;
+
     Context         mContext = {};
     Instance       mInstance = { VK_NULL_HANDLE };
     PhysicalDevice      mGPU = { VK_NULL_HANDLE };
     Device           mDevice = { VK_NULL_HANDLE };
     SurfaceKHR      mSurface = { VK_NULL_HANDLE };
     Swapchain     mSwapchain = { VK_NULL_HANDLE };
+    Timeline       mTimeline = { VK_NULL_HANDLE }; // device-wide frame/submit counter
+    DeletionQueue  mDeletionQueue;
+    PipelineCache  mPipelineCache = { VK_NULL_HANDLE };
+    StagingRing    mStaging       = { nullptr };
+    Defragmenter   mDefragmenter  = { nullptr };
+    std::string    mPipelineCachePath;
+
+    struct
+    {
+        std::vector<Image> images = {};
+        Queue               queue = { VK_NULL_HANDLE }; // signals "acquire" and consumes "present" semaphores
+        uint32_t            index = 0;
+        Format             format = Format::eR8G8B8A8Unorm;
+    } mOffscreen;
+
+    struct
+    {
+        Queue        queue = { VK_NULL_HANDLE };
+        uint32_t    family = UINT32_MAX;
+        bool     dedicated = false;
+    } mTransfer;
+
+    struct
+    {
+        bool drawIndirectCount = false;
+    } mFeatures;
 
-    std::map<QueueFlags, uint32_t> mQueueFamilies = {};
-    CreateInfo                     mCreateInfo    = {};
+    std::map<QueueFlags, uint32_t> mQueueFamilies  = {};
+    uint32_t                       mGraphicsFamily = UINT32_MAX;
+    CreateInfo                     mCreateInfo     = {};
+    bool                           mHeadless       = false;
 };
 
 }
@@ -0,0 +1,202 @@
+#include "vk_culling.h"
+#include "vk_context.h"
+#include "vk_utils.h"
+
+namespace polyp {
+namespace vulkan {
+
+namespace {
+
+constexpr uint32_t kGroupSize = 64;
+constexpr uint32_t kBindings  = 3; // objects, commands, count
+
+} // namespace
+
+CullingPass::CullingPass(const ShaderModule& shader, const std::vector<Object>& objects, uint32_t frames)
+{
+    auto& ctx          = RHIContext::get();
+    const auto& device = ctx.device();
+
+    if (*shader == VK_NULL_HANDLE || objects.empty() || frames == 0)
+        return;
+
+    mObjectCount = static_cast<uint32_t>(objects.size());
+    mObjects     = utils::createDeviceBuffer(sizeof(Object) * objects.size(),
+                                             vk::BufferUsageFlagBits::eStorageBuffer | vk::BufferUsageFlagBits::eTransferDst);
+
+    if (*mObjects == VK_NULL_HANDLE || !ctx.staging().upload(objects, mObjects))
+    {
+        POLYPERROR("Failed to upload %u culling objects", mObjectCount);
+        return;
+    }
+
+    ctx.staging().submit();
+
+    std::array<vk::DescriptorSetLayoutBinding, kBindings> bindings{};
+    for (uint32_t i = 0; i < kBindings; ++i)
+    {
+        bindings[i].binding         = i;
+        bindings[i].descriptorType  = vk::DescriptorType::eStorageBuffer;
+        bindings[i].descriptorCount = 1;
+        bindings[i].stageFlags      = vk::ShaderStageFlagBits::eCompute;
+    }
+
+    vk::DescriptorSetLayoutCreateInfo dsLayoutCreateInfo{};
+    dsLayoutCreateInfo.bindingCount = kBindings;
+    dsLayoutCreateInfo.pBindings    = bindings.data();
+
+    mDSLayout = device.createDescriptorSetLayout(dsLayoutCreateInfo);
+
+    vk::PushConstantRange pushConstantRange{};
+    pushConstantRange.stageFlags = vk::ShaderStageFlagBits::eCompute;
+    pushConstantRange.size       = sizeof(Params);
+
+    vk::PipelineLayoutCreateInfo pipeLayoutCreateInfo{};
+    pipeLayoutCreateInfo.setLayoutCount         = 1;
+    pipeLayoutCreateInfo.pSetLayouts            = &*mDSLayout;
+    pipeLayoutCreateInfo.pushConstantRangeCount = 1;
+    pipeLayoutCreateInfo.pPushConstantRanges    = &pushConstantRange;
+
+    mLayout = device.createPipelineLayout(pipeLayoutCreateInfo);
+
+    vk::DescriptorPoolSize descriptorPoolSize;
+    descriptorPoolSize.type            = vk::DescriptorType::eStorageBuffer;
+    descriptorPoolSize.descriptorCount = kBindings * frames;
+
+    vk::DescriptorPoolCreateInfo dsPoolCreateInfo{};
+    dsPoolCreateInfo.poolSizeCount = 1;
+    dsPoolCreateInfo.pPoolSizes    = &descriptorPoolSize;
+    dsPoolCreateInfo.maxSets       = frames;
+    dsPoolCreateInfo.flags         = vk::DescriptorPoolCreateFlagBits::eFreeDescriptorSet;
+
+    mPool = device.createDescriptorPool(dsPoolCreateInfo);
+
+    std::vector<vk::DescriptorSetLayout> layouts(frames, *mDSLayout);
+
+    vk::DescriptorSetAllocateInfo dsAllocInfo{};
+    dsAllocInfo.descriptorPool     = *mPool;
+    dsAllocInfo.descriptorSetCount = frames;
+    dsAllocInfo.pSetLayouts        = layouts.data();
+
+    auto sets = device.allocateDescriptorSets(dsAllocInfo);
+    POLYPASSERT(sets.size() == frames);
+
+    for (uint32_t i = 0; i < frames; ++i)
+    {
+        Frame frame;
+        frame.commands = utils::createDeviceBuffer(sizeof(vk::DrawIndexedIndirectCommand) * mObjectCount,
+                                                   vk::BufferUsageFlagBits::eStorageBuffer | vk::BufferUsageFlagBits::eIndirectBuffer);
+        frame.count    = utils::createDeviceBuffer(sizeof(uint32_t),
+                                                   vk::BufferUsageFlagBits::eStorageBuffer | vk::BufferUsageFlagBits::eIndirectBuffer |
+                                                   vk::BufferUsageFlagBits::eTransferDst   | vk::BufferUsageFlagBits::eTransferSrc);
+        frame.readback = utils::createReadbackBuffer(sizeof(uint32_t));
+        frame.set      = std::move(sets[i]);
+
+        if (*frame.commands == VK_NULL_HANDLE || *frame.count == VK_NULL_HANDLE || frame.readback.mappedData() == nullptr)
+        {
+            POLYPERROR("Failed to create culling buffers");
+            mFrames.clear();
+            return;
+        }
+
+        std::array<vk::DescriptorBufferInfo, kBindings> buffersInfo{};
+        buffersInfo[0] = { *mObjects,        0, VK_WHOLE_SIZE };
+        buffersInfo[1] = { *frame.commands,  0, VK_WHOLE_SIZE };
+        buffersInfo[2] = { *frame.count,     0, VK_WHOLE_SIZE };
+
+        vk::WriteDescriptorSet writeDescriptorSet{};
+        writeDescriptorSet.dstSet          = *frame.set;
+        writeDescriptorSet.dstBinding      = 0;
+        writeDescriptorSet.descriptorCount = kBindings;
+        writeDescriptorSet.descriptorType  = vk::DescriptorType::eStorageBuffer;
+        writeDescriptorSet.pBufferInfo     = buffersInfo.data();
+
+        device.updateDescriptorSets({ writeDescriptorSet }, {});
+
+        mFrames.push_back(std::move(frame));
+    }
+
+    vk::ComputePipelineCreateInfo pipeCreateInfo{};
+    pipeCreateInfo.layout       = *mLayout;
+    pipeCreateInfo.stage.stage  = vk::ShaderStageFlagBits::eCompute;
+    pipeCreateInfo.stage.module = *shader;
+    pipeCreateInfo.stage.pName  = "main";
+
+    mPipeline = device.createComputePipeline(ctx.pipelineCache(), pipeCreateInfo);
+}
+
+CullingPass& CullingPass::operator=(CullingPass&& rhv) noexcept
+{
+    // The descriptor sets go back to the pool before it is replaced
+    mFrames.clear();
+
+    mObjects     = std::move(rhv.mObjects);
+    mDSLayout    = std::move(rhv.mDSLayout);
+    mLayout      = std::move(rhv.mLayout);
+    mPool        = std::move(rhv.mPool);
+    mPipeline    = std::move(rhv.mPipeline);
+    mFrames      = std::move(rhv.mFrames);
+    mObjectCount = rhv.mObjectCount;
+    mVisible     = rhv.mVisible;
+
+    return *this;
+}
+
+void CullingPass::record(const CommandBuffer& cmd, uint32_t frameIndex, const View& view)
+{
+    auto& frame = mFrames[frameIndex];
+
+    // The frame's previous culling has been completed, its count is in the readback buffer
+    if (frame.recorded)
+    {
+        frame.readback.invalidate(0, sizeof(uint32_t));
+        mVisible = *static_cast<const uint32_t*>(frame.readback.mappedData());
+    }
+
+    Params params{};
+    for (uint32_t i = 0; i < Frustum::Count; ++i)
+        params.planes[i] = view.frustum.planes[i];
+
+    params.eye         = glm::vec4(view.eye, view.scale);
+    params.objectCount = mObjectCount;
+    params.minPixels   = view.minPixels;
+
+    cmd.fillBuffer(*frame.count, 0, sizeof(uint32_t), 0);
+
+    std::array<vk::MemoryBarrier, 1> barriers{};
+    barriers[0].srcAccessMask = vk::AccessFlagBits::eTransferWrite;
+    barriers[0].dstAccessMask = vk::AccessFlagBits::eShaderRead | vk::AccessFlagBits::eShaderWrite;
+
+    cmd.pipelineBarrier(vk::PipelineStageFlagBits::eTransfer, vk::PipelineStageFlagBits::eComputeShader, {}, barriers, {}, {});
+
+    cmd.bindPipeline(vk::PipelineBindPoint::eCompute, *mPipeline);
+    cmd.bindDescriptorSets(vk::PipelineBindPoint::eCompute, *mLayout, 0, { *frame.set }, {});
+    cmd.pushConstants<Params>(*mLayout, vk::ShaderStageFlagBits::eCompute, 0, params);
+    cmd.dispatch((mObjectCount + kGroupSize - 1) / kGroupSize, 1, 1);
+
+    barriers[0].srcAccessMask = vk::AccessFlagBits::eShaderWrite;
+    barriers[0].dstAccessMask = vk::AccessFlagBits::eIndirectCommandRead | vk::AccessFlagBits::eTransferRead;
+
+    cmd.pipelineBarrier(vk::PipelineStageFlagBits::eComputeShader,
+                        vk::PipelineStageFlagBits::eDrawIndirect | vk::PipelineStageFlagBits::eTransfer, {}, barriers, {}, {});
+
+    // Stats only, read when the frame index comes around again
+    cmd.copyBuffer(*frame.count, *frame.readback, { vk::BufferCopy{ 0, 0, sizeof(uint32_t) } });
+
+    barriers[0].srcAccessMask = vk::AccessFlagBits::eTransferWrite;
+    barriers[0].dstAccessMask = vk::AccessFlagBits::eHostRead;
+
+    cmd.pipelineBarrier(vk::PipelineStageFlagBits::eTransfer, vk::PipelineStageFlagBits::eHost, {}, barriers, {}, {});
+
+    frame.recorded = true;
+}
+
+void CullingPass::draw(const CommandBuffer& cmd, uint32_t frameIndex) const
+{
+    const auto& frame = mFrames[frameIndex];
+
+    cmd.drawIndexedIndirectCount(*frame.commands, 0, *frame.count, 0, mObjectCount, sizeof(vk::DrawIndexedIndirectCommand));
+}
+
+}
+}
@@ -0,0 +1,99 @@
+#pragma once
+
+#include "vk_common.h"
+
+#include <frustum.h>
+
+namespace polyp {
+namespace vulkan {
+
+/// GPU culling of draw objects. A compute pass tests every object's bounding sphere against the
+/// frustum planes and its projected size against a pixel threshold, survivors are compacted into
+/// an indirect command buffer and a draw count consumed by drawIndexedIndirectCount.
+/// The commands and the count are per frame in flight, the count of a frame is read back when
+/// the frame index is recorded again.
+///
+/// Shader contract: local_size_x = 64, set 0 with the storage buffers
+/// objects (binding 0, Object[]), commands (binding 1, VkDrawIndexedIndirectCommand[]), count (binding 2, uint)
+/// and Params as push constants.
+class CullingPass
+{
+public:
+    /// std430 layout of an object, an object is drawn by its own command with instanceCount = 1
+    struct Object
+    {
+        glm::vec4 sphere       = {};  // xyz center, w radius; in the space the frustum is extracted in
+        uint32_t  indexCount   = 0;
+        uint32_t  firstIndex   = 0;
+        int32_t   vertexOffset = 0;
+        uint32_t  instance     = 0;   // firstInstance of the command, selects per-instance vertex data
+    };
+
+    struct View
+    {
+        Frustum   frustum   = {};
+        glm::vec3 eye       = {};   // camera position in the frustum space
+        float     scale     = 0.f;  // pixels covered by a unit at distance 1: P[1][1] * height / 2
+        float     minPixels = 0.f;  // objects projected to a smaller diameter are culled, 0 turns it off
+    };
+
+    struct Stats
+    {
+        uint32_t objects = 0;
+        uint32_t visible = 0; // of the latest frame read back
+    };
+
+    CullingPass(std::nullptr_t ptr)
+    { }
+
+    CullingPass(const ShaderModule& shader, const std::vector<Object>& objects, uint32_t frames);
+
+    CullingPass(const CullingPass&)            = delete;
+    CullingPass& operator=(const CullingPass&) = delete;
+    CullingPass(CullingPass&&)                 = default;
+    CullingPass& operator=(CullingPass&& rhv) noexcept;
+
+    explicit operator bool() const noexcept { return *mPipeline != VK_NULL_HANDLE; }
+
+    /// Records the culling of the frame outside a render pass. The previous results of the frame index
+    /// have to be completed on the GPU.
+    void record(const CommandBuffer& cmd, uint32_t frameIndex, const View& view);
+
+    /// Draws the survivors, vertex and index buffers have to be bound
+    void draw(const CommandBuffer& cmd, uint32_t frameIndex) const;
+
+    Stats stats() const noexcept { return { mObjectCount, mVisible }; }
+
+private:
+    struct Params
+    {
+        glm::vec4 planes[Frustum::Count];
+        glm::vec4 eye;         // w: View::scale
+        uint32_t  objectCount;
+        float     minPixels;
+        uint32_t  padding[2];
+    };
+
+    static_assert(sizeof(Params) <= 128, "Culling params exceed the guaranteed push constants size");
+
+    struct Frame
+    {
+        Buffer        commands = { VK_NULL_HANDLE };
+        Buffer        count    = { VK_NULL_HANDLE };
+        Buffer        readback = { VK_NULL_HANDLE }; // host copy of count
+        DescriptorSet set      = { VK_NULL_HANDLE };
+        bool          recorded = false;
+    };
+
+    Buffer              mObjects     = { VK_NULL_HANDLE };
+    DescriptorSetLayout mDSLayout    = { VK_NULL_HANDLE };
+    PipelineLayout      mLayout      = { VK_NULL_HANDLE };
+    DescriptorPool      mPool        = { VK_NULL_HANDLE };
+    Pipeline            mPipeline    = { VK_NULL_HANDLE };
+    std::vector<Frame>  mFrames;
+    uint32_t            mObjectCount = 0;
+    uint32_t            mVisible     = 0;
+};
+
+}
+}
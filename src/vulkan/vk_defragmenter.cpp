@@ -0,0 +1,341 @@
+#include "vk_defragmenter.h"
+#include "vk_context.h"
+
+namespace polyp {
+namespace vulkan {
+
+Defragmenter::Defragmenter(VkDeviceSize maxBytesPerPass, uint32_t maxMovesPerPass) :
+    mMaxBytes(maxBytesPerPass), mMaxMoves(maxMovesPerPass)
+{ }
+
+Defragmenter::Defragmenter(Defragmenter&& rhv) noexcept
+{
+    std::swap(mContext,    rhv.mContext);
+    std::swap(mPass,       rhv.mPass);
+    std::swap(mMoves,      rhv.mMoves);
+    std::swap(mMaxBytes,   rhv.mMaxBytes);
+    std::swap(mMaxMoves,   rhv.mMaxMoves);
+    std::swap(mValue,      rhv.mValue);
+    std::swap(mFrames,     rhv.mFrames);
+    std::swap(mGeneration, rhv.mGeneration);
+    std::swap(mState,      rhv.mState);
+}
+
+Defragmenter& Defragmenter::operator=(Defragmenter&& rhv) noexcept
+{
+    std::swap(mContext,    rhv.mContext);
+    std::swap(mPass,       rhv.mPass);
+    std::swap(mMoves,      rhv.mMoves);
+    std::swap(mMaxBytes,   rhv.mMaxBytes);
+    std::swap(mMaxMoves,   rhv.mMaxMoves);
+    std::swap(mValue,      rhv.mValue);
+    std::swap(mFrames,     rhv.mFrames);
+    std::swap(mGeneration, rhv.mGeneration);
+    std::swap(mState,      rhv.mState);
+
+    return *this;
+}
+
+Defragmenter::~Defragmenter()
+{
+    destroy();
+}
+
+void Defragmenter::request()
+{
+    if (running() || mMaxBytes == 0 || mMaxMoves == 0)
+        return;
+
+    VmaDefragmentationInfo info{};
+    info.flags                 = VMA_DEFRAGMENTATION_FLAG_ALGORITHM_BALANCED_BIT;
+    info.maxBytesPerPass       = mMaxBytes;
+    info.maxAllocationsPerPass = mMaxMoves;
+
+    auto res = vmaBeginDefragmentation(RHIContext::get().device().vmaAlocator(), &info, &mContext);
+    if (res != VK_SUCCESS)
+    {
+        POLYPERROR("Failed to begin defragmentation: %s", vk::to_string(static_cast<vk::Result>(res)).c_str());
+        mContext = VK_NULL_HANDLE;
+        return;
+    }
+
+    mState = State::Ready;
+}
+
+void Defragmenter::update()
+{
+    auto& timeline = RHIContext::get().timeline();
+
+    switch (mState)
+    {
+    case State::Idle:
+        if (POLYP_DEFRAG_CHECK_FRAMES > 0 && ++mFrames % POLYP_DEFRAG_CHECK_FRAMES == 0 && fragmented())
+            request();
+        break;
+    case State::Copying:
+        if (timeline.isCompleted(mValue))
+            swap();
+        break;
+    case State::Retiring:
+        if (timeline.isCompleted(mValue))
+        {
+            if (endPass() == VK_SUCCESS)
+                finish();
+            else
+                mState = State::Ready;
+        }
+        break;
+    default:
+        break;
+    }
+}
+
+void Defragmenter::record(const CommandBuffer& cmd)
+{
+    if (mState != State::Ready)
+        return;
+
+    POLYPTRACE("Defragmentation pass");
+
+    auto& ctx            = RHIContext::get();
+    const auto& device   = ctx.device();
+    auto allocator       = device.vmaAlocator();
+    auto* dispatcher     = device.getDispatcher();
+    const auto vkDevice  = static_cast<VkDevice>(*device);
+
+    auto res = vmaBeginDefragmentationPass(allocator, mContext, &mPass);
+    if (res == VK_SUCCESS)
+    {
+        finish();
+        return;
+    }
+
+    mMoves.clear();
+    mMoves.reserve(mPass.moveCount);
+
+    for (uint32_t i = 0; i < mPass.moveCount; ++i)
+    {
+        auto& move = mPass.pMoves[i];
+
+        VmaAllocationInfo info{};
+        vmaGetAllocationInfo(allocator, move.srcAllocation, &info);
+
+        auto* buffer = static_cast<Buffer*>(info.pUserData);
+        if (buffer == nullptr || !buffer->mMovable)
+        {
+            move.operation = VMA_DEFRAGMENTATION_MOVE_OPERATION_IGNORE;
+            continue;
+        }
+
+        VkBufferCreateInfo createInfo{ VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO };
+        createInfo.size        = buffer->mSize;
+        createInfo.usage       = static_cast<VkBufferUsageFlags>(buffer->mUsage);
+        createInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+
+        VkBuffer dst = VK_NULL_HANDLE;
+        if (dispatcher->vkCreateBuffer(vkDevice, &createInfo, nullptr, &dst) != VK_SUCCESS)
+        {
+            move.operation = VMA_DEFRAGMENTATION_MOVE_OPERATION_IGNORE;
+            continue;
+        }
+
+        if (vmaBindBufferMemory(allocator, move.dstTmpAllocation, dst) != VK_SUCCESS)
+        {
+            dispatcher->vkDestroyBuffer(vkDevice, dst, nullptr);
+            move.operation = VMA_DEFRAGMENTATION_MOVE_OPERATION_IGNORE;
+            continue;
+        }
+
+        buffer->mMoving = true;
+        mMoves.push_back({ i, move.srcAllocation, dst, VK_NULL_HANDLE });
+    }
+
+    // Nothing movable in this pass, the rest of the pools wouldn't be different
+    if (mMoves.empty())
+    {
+        endPass();
+        finish();
+        return;
+    }
+
+    std::array<vk::MemoryBarrier, 1> barriers{};
+    barriers[0].srcAccessMask = vk::AccessFlagBits::eTransferWrite | vk::AccessFlagBits::eMemoryWrite;
+    barriers[0].dstAccessMask = vk::AccessFlagBits::eTransferRead;
+
+    cmd.pipelineBarrier(vk::PipelineStageFlagBits::eAllCommands, vk::PipelineStageFlagBits::eTransfer, {}, barriers, {}, {});
+
+    for (const auto& move : mMoves)
+    {
+        VmaAllocationInfo info{};
+        vmaGetAllocationInfo(allocator, move.allocation, &info);
+
+        const auto* buffer = static_cast<Buffer*>(info.pUserData);
+
+        cmd.copyBuffer(**buffer, move.dst, { vk::BufferCopy{ 0, 0, buffer->mSize } });
+    }
+
+    barriers[0].srcAccessMask = vk::AccessFlagBits::eTransferWrite;
+    barriers[0].dstAccessMask = vk::AccessFlagBits::eMemoryRead;
+
+    cmd.pipelineBarrier(vk::PipelineStageFlagBits::eTransfer, vk::PipelineStageFlagBits::eAllCommands, {}, barriers, {}, {});
+
+    mValue = ctx.timeline().submitted() + 1;
+    mState = State::Copying;
+}
+
+void Defragmenter::swap()
+{
+    auto& ctx           = RHIContext::get();
+    const auto& device  = ctx.device();
+    auto allocator      = device.vmaAlocator();
+    const auto vkDevice = static_cast<VkDevice>(*device);
+
+    bool swapped = false;
+
+    for (auto& move : mMoves)
+    {
+        VmaAllocationInfo info{};
+        vmaGetAllocationInfo(allocator, move.allocation, &info);
+
+        // The buffer has been destroyed during the copy, VMA frees its allocation with the pass
+        auto* buffer = static_cast<Buffer*>(info.pUserData);
+        if (buffer == nullptr)
+        {
+            mPass.pMoves[move.index].operation = VMA_DEFRAGMENTATION_MOVE_OPERATION_DESTROY;
+            move.orphaned = true;
+            device.getDispatcher()->vkDestroyBuffer(vkDevice, move.dst, nullptr);
+            move.dst = VK_NULL_HANDLE;
+            continue;
+        }
+
+        move.src = static_cast<VkBuffer>(buffer->release());
+        static_cast<vk::raii::Buffer&>(*buffer) = vk::raii::Buffer(device, move.dst);
+        move.dst = VK_NULL_HANDLE;
+
+        swapped = true;
+    }
+
+    if (swapped)
+        ++mGeneration;
+
+    // Frames recorded before the swap may still use the old handles and memory
+    mValue = ctx.timeline().submitted();
+    mState = State::Retiring;
+}
+
+VkResult Defragmenter::endPass()
+{
+    const auto& device  = RHIContext::get().device();
+    auto allocator      = device.vmaAlocator();
+    auto* dispatcher    = device.getDispatcher();
+    const auto vkDevice = static_cast<VkDevice>(*device);
+
+    for (const auto& move : mMoves)
+    {
+        if (move.src != VK_NULL_HANDLE)
+            dispatcher->vkDestroyBuffer(vkDevice, move.src, nullptr);
+    }
+
+    auto res = vmaEndDefragmentationPass(allocator, mContext, &mPass);
+
+    for (const auto& move : mMoves)
+    {
+        if (move.orphaned)
+            continue;
+
+        VmaAllocationInfo info{};
+        vmaGetAllocationInfo(allocator, move.allocation, &info);
+
+        // Destroyed after the swap, the allocation was left to the pass
+        auto* buffer = static_cast<Buffer*>(info.pUserData);
+        if (buffer == nullptr)
+        {
+            vmaFreeMemory(allocator, move.allocation);
+            continue;
+        }
+
+        buffer->mAllocationVMAInfo = info;
+        buffer->mMoving            = false;
+    }
+
+    mMoves.clear();
+
+    return res;
+}
+
+void Defragmenter::finish()
+{
+    VmaDefragmentationStats stats{};
+    vmaEndDefragmentation(RHIContext::get().device().vmaAlocator(), mContext, &stats);
+
+    if (stats.allocationsMoved > 0 || stats.deviceMemoryBlocksFreed > 0)
+    {
+        POLYPINFO("Defragmentation moved %u allocations (%llu bytes), freed %u blocks (%llu bytes)",
+            stats.allocationsMoved, static_cast<unsigned long long>(stats.bytesMoved),
+            stats.deviceMemoryBlocksFreed, static_cast<unsigned long long>(stats.bytesFreed));
+    }
+
+    mContext = VK_NULL_HANDLE;
+    mPass    = {};
+    mState   = State::Idle;
+}
+
+void Defragmenter::destroy()
+{
+    if (!running())
+        return;
+
+    // The device is idle: the copies are complete, but the handles are left as they were
+    if (mState == State::Copying)
+    {
+        const auto& device = RHIContext::get().device();
+        auto allocator     = device.vmaAlocator();
+
+        for (auto& move : mMoves)
+        {
+            VmaAllocationInfo info{};
+            vmaGetAllocationInfo(allocator, move.allocation, &info);
+
+            move.orphaned = info.pUserData == nullptr;
+            mPass.pMoves[move.index].operation = move.orphaned ? VMA_DEFRAGMENTATION_MOVE_OPERATION_DESTROY
+                                                               : VMA_DEFRAGMENTATION_MOVE_OPERATION_IGNORE;
+
+            device.getDispatcher()->vkDestroyBuffer(static_cast<VkDevice>(*device), move.dst, nullptr);
+            move.dst = VK_NULL_HANDLE;
+        }
+    }
+
+    if (mState == State::Copying || mState == State::Retiring)
+        endPass();
+
+    finish();
+}
+
+bool Defragmenter::fragmented() const
+{
+    auto allocator = RHIContext::get().device().vmaAlocator();
+
+    // Checked from the frame loop, the budgets are read in place instead of the vector of getHeapBudgetsPLP()
+    const VkPhysicalDeviceMemoryProperties* memProps = nullptr;
+    vmaGetMemoryProperties(allocator, &memProps);
+
+    std::array<VmaBudget, VK_MAX_MEMORY_HEAPS> budgets{};
+    vmaGetHeapBudgets(allocator, budgets.data());
+
+    VkDeviceSize blocks      = 0;
+    VkDeviceSize allocations = 0;
+
+    for (uint32_t i = 0; i < memProps->memoryHeapCount; ++i)
+    {
+        blocks      += budgets[i].statistics.blockBytes;
+        allocations += budgets[i].statistics.allocationBytes;
+    }
+
+    // Worth it when the free space in the blocks exceeds a pass budget and a quarter of the blocks
+    const auto unused = blocks - allocations;
+
+    return unused > mMaxBytes && unused * 4 > blocks;
+}
+
+}
+}
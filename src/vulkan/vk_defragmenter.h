@@ -0,0 +1,87 @@
+#pragma once
+
+#include "vk_common.h"
+
+namespace polyp {
+namespace vulkan {
+
+/// Incremental defragmentation of the VMA default pools behind Device::createBufferPLP().
+/// A pass moves at most a budget of bytes and allocations per frame: the copies are recorded into
+/// the frame prologue, once they are done the moved Buffer objects get the new VkBuffer handles in
+/// place, and the old memory is released when no frame in flight can use the old handles anymore.
+/// So owners keep their Buffer objects, only the handles bound at record time change.
+///
+/// Only buffers marked with Buffer::setMovable() are moved, images are left in place.
+/// A movable buffer must not be written on the GPU between the pass recording and the handle swap.
+class Defragmenter
+{
+public:
+    Defragmenter(std::nullptr_t ptr)
+    { }
+
+    Defragmenter(VkDeviceSize maxBytesPerPass, uint32_t maxMovesPerPass);
+
+    Defragmenter(const Defragmenter&)            = delete;
+    Defragmenter& operator=(const Defragmenter&) = delete;
+
+    Defragmenter(Defragmenter&& rhv) noexcept;
+    Defragmenter& operator=(Defragmenter&& rhv) noexcept;
+
+    /// Ends a running defragmentation, the device must be idle
+    ~Defragmenter();
+
+    /// Starts a defragmentation unless one is running
+    void request();
+
+    bool running() const noexcept { return mContext != VK_NULL_HANDLE; }
+
+    /// Advances the running pass whose GPU work has been completed and starts a defragmentation
+    /// when the pools get fragmented. Called once per frame before the frame recording.
+    void update();
+
+    /// A pass is waiting to be recorded with record()
+    bool hasPass() const noexcept { return mState == State::Ready; }
+
+    /// Changes whenever moved buffers get their new handles, commands recorded before still bind the old ones
+    uint64_t generation() const noexcept { return mGeneration; }
+
+    /// Begins a pass and records its copies, cmd has to be submitted with the next frame
+    void record(const CommandBuffer& cmd);
+
+private:
+    enum class State
+    {
+        Idle,
+        Ready,    // the next pass is to be recorded
+        Copying,  // the copies are in flight, the buffers still use the old handles
+        Retiring  // the buffers use the new handles, frames in flight may use the old ones
+    };
+
+    struct Move
+    {
+        uint32_t      index      = 0;              // in the VMA pass moves
+        VmaAllocation allocation = VK_NULL_HANDLE;
+        VkBuffer      dst        = VK_NULL_HANDLE; // bound to the new place until the swap
+        VkBuffer      src        = VK_NULL_HANDLE; // the old handle after the swap
+        bool          orphaned   = false;          // the buffer died before the swap, VMA frees the allocation
+    };
+
+    void swap();
+    VkResult endPass();
+    void finish();
+    void destroy();
+    bool fragmented() const;
+
+    VmaDefragmentationContext      mContext    = VK_NULL_HANDLE;
+    VmaDefragmentationPassMoveInfo mPass       = {};
+    std::vector<Move>              mMoves;
+    VkDeviceSize                   mMaxBytes   = 0;
+    uint32_t                       mMaxMoves   = 0;
+    uint64_t                       mValue      = 0; // device timeline value the current state waits for
+    uint64_t                       mFrames     = 0;
+    uint64_t                       mGeneration = 0;
+    State                          mState      = State::Idle;
+};
+
+}
+}
@@ -0,0 +1,49 @@
+#include "vk_deletion_queue.h"
+
+namespace polyp {
+namespace vulkan {
+
+void DeletionQueue::add(std::unique_ptr<Resource> resource, uint64_t value)
+{
+    std::lock_guard lock(mMutex);
+
+    // Keep the queue sorted, so collect() only looks at the front
+    auto it = mEntries.end();
+    while (it != mEntries.begin() && std::prev(it)->first > value)
+        --it;
+
+    mEntries.emplace(it, value, std::move(resource));
+}
+
+void DeletionQueue::collect(uint64_t completed)
+{
+    std::vector<std::unique_ptr<Resource>> retired;
+
+    {
+        std::lock_guard lock(mMutex);
+
+        while (!mEntries.empty() && mEntries.front().first <= completed)
+        {
+            retired.push_back(std::move(mEntries.front().second));
+            mEntries.pop_front();
+        }
+    }
+
+    // Destroyed outside of the lock: destructors of retired objects may retire something else
+    retired.clear();
+}
+
+void DeletionQueue::flush()
+{
+    while (!empty())
+        collect(UINT64_MAX);
+}
+
+bool DeletionQueue::empty() const
+{
+    std::lock_guard lock(mMutex);
+    return mEntries.empty();
+}
+
+}
+}
@@ -0,0 +1,80 @@
+#pragma once
+
+#include "vk_common.h"
+
+#include <deque>
+#include <mutex>
+
+namespace polyp {
+namespace vulkan {
+
+/// Holds GPU objects until the timeline value of the last submission that may use them is reached.
+/// Any movable object is accepted (raii handles, containers of them, Buffer/Image), raw handles are
+/// released with a callback.
+class DeletionQueue
+{
+public:
+    DeletionQueue() = default;
+
+    DeletionQueue(const DeletionQueue&)            = delete;
+    DeletionQueue& operator=(const DeletionQueue&) = delete;
+
+    ~DeletionQueue() { flush(); }
+
+    template<typename T>
+    void push(T&& object, uint64_t value)
+    {
+        static_assert(!std::is_lvalue_reference_v<T>, "Deletion queue takes ownership, move the object in");
+
+        add(std::make_unique<Holder<T>>(std::move(object)), value);
+    }
+
+    template<typename Func>
+    void pushCallback(Func&& callback, uint64_t value)
+    {
+        add(std::make_unique<Callback<std::decay_t<Func>>>(std::forward<Func>(callback)), value);
+    }
+
+    /// Destroys everything retired at or before the completed timeline value
+    void collect(uint64_t completed);
+
+    /// Destroys everything. The caller guarantees the device is idle.
+    void flush();
+
+    bool empty() const;
+
+private:
+    struct Resource
+    {
+        virtual ~Resource() = default;
+    };
+
+    template<typename T>
+    struct Holder final : Resource
+    {
+        explicit Holder(T&& obj) : object(std::move(obj)) { }
+
+        T object;
+    };
+
+    template<typename Func>
+    struct Callback final : Resource
+    {
+        explicit Callback(Func&& func) : callback(std::move(func)) { }
+        explicit Callback(const Func& func) : callback(func) { }
+
+        ~Callback() override { callback(); }
+
+        Func callback;
+    };
+
+    using Entry = std::pair<uint64_t, std::unique_ptr<Resource>>;
+
+    void add(std::unique_ptr<Resource> resource, uint64_t value);
+
+    mutable std::mutex mMutex;
+    std::deque<Entry>  mEntries;
+};
+
+}
+}
@@ -0,0 +1,320 @@
+#include "vk_geometry_heap.h"
+#include "vk_context.h"
+#include "vk_utils.h"
+
+namespace polyp {
+namespace vulkan {
+
+namespace {
+
+const auto kVertexUsage = vk::BufferUsageFlagBits::eVertexBuffer | vk::BufferUsageFlagBits::eTransferDst | vk::BufferUsageFlagBits::eTransferSrc;
+const auto kIndexUsage  = vk::BufferUsageFlagBits::eIndexBuffer  | vk::BufferUsageFlagBits::eTransferDst | vk::BufferUsageFlagBits::eTransferSrc;
+
+VmaVirtualBlock createBlock(uint32_t capacity)
+{
+    VmaVirtualBlockCreateInfo createInfo{};
+    createInfo.size = capacity;
+
+    VmaVirtualBlock block = VK_NULL_HANDLE;
+
+    auto res = vmaCreateVirtualBlock(&createInfo, &block);
+    if (res != VK_SUCCESS)
+        detail::throwResultException(static_cast<vk::Result>(res), __FUNCTION__);
+
+    return block;
+}
+
+bool allocateRange(VmaVirtualBlock block, uint32_t count, VmaVirtualAllocation& allocation, uint32_t& offset)
+{
+    VmaVirtualAllocationCreateInfo createInfo{};
+    createInfo.size = count;
+
+    VkDeviceSize rangeOffset = 0;
+
+    if (vmaVirtualAllocate(block, &createInfo, &allocation, &rangeOffset) != VK_SUCCESS)
+        return false;
+
+    offset = static_cast<uint32_t>(rangeOffset);
+
+    return true;
+}
+
+} // namespace
+
+GeometryHeap::GeometryHeap(uint32_t vertexStride, uint32_t vertexCapacity, uint32_t indexCapacity) :
+    mStride(vertexStride), mVertexCapacity(vertexCapacity), mIndexCapacity(indexCapacity)
+{
+    mVertexBuffer = utils::createDeviceBuffer(static_cast<VkDeviceSize>(vertexStride) * vertexCapacity, kVertexUsage);
+    mIndexBuffer  = utils::createDeviceBuffer(sizeof(uint32_t) * static_cast<VkDeviceSize>(indexCapacity), kIndexUsage);
+
+    if (*mVertexBuffer == VK_NULL_HANDLE || *mIndexBuffer == VK_NULL_HANDLE)
+    {
+        POLYPERROR("Failed to create geometry heap buffers");
+        return;
+    }
+
+    // Bound per frame by bind(), so the defragmenter may swap the handles between frames
+    mVertexBuffer.setMovable(true);
+    mIndexBuffer.setMovable(true);
+
+    mVertexBlock = createBlock(vertexCapacity);
+    mIndexBlock  = createBlock(indexCapacity);
+}
+
+GeometryHeap::GeometryHeap(GeometryHeap&& rhv) noexcept :
+    mVertexBuffer(std::move(rhv.mVertexBuffer)), mIndexBuffer(std::move(rhv.mIndexBuffer))
+{
+    std::swap(mVertexBlock,    rhv.mVertexBlock);
+    std::swap(mIndexBlock,     rhv.mIndexBlock);
+    std::swap(mStride,         rhv.mStride);
+    std::swap(mVertexCapacity, rhv.mVertexCapacity);
+    std::swap(mIndexCapacity,  rhv.mIndexCapacity);
+    std::swap(mEntries,        rhv.mEntries);
+    std::swap(mFreeIds,        rhv.mFreeIds);
+    std::swap(mPendingFrees,   rhv.mPendingFrees);
+    std::swap(mGeneration,     rhv.mGeneration);
+}
+
+GeometryHeap& GeometryHeap::operator=(GeometryHeap&& rhv) noexcept
+{
+    mVertexBuffer = std::move(rhv.mVertexBuffer);
+    mIndexBuffer  = std::move(rhv.mIndexBuffer);
+
+    std::swap(mVertexBlock,    rhv.mVertexBlock);
+    std::swap(mIndexBlock,     rhv.mIndexBlock);
+    std::swap(mStride,         rhv.mStride);
+    std::swap(mVertexCapacity, rhv.mVertexCapacity);
+    std::swap(mIndexCapacity,  rhv.mIndexCapacity);
+    std::swap(mEntries,        rhv.mEntries);
+    std::swap(mFreeIds,        rhv.mFreeIds);
+    std::swap(mPendingFrees,   rhv.mPendingFrees);
+    std::swap(mGeneration,     rhv.mGeneration);
+
+    return *this;
+}
+
+GeometryHeap::~GeometryHeap()
+{
+    destroy();
+}
+
+GeometryHeap::MeshId GeometryHeap::allocate(uint32_t vertexCount, uint32_t indexCount)
+{
+    if (mVertexBlock == VK_NULL_HANDLE || vertexCount == 0 || indexCount == 0)
+        return kInvalidMesh;
+
+    collect();
+
+    Entry    entry{};
+    uint32_t vertexOffset = 0;
+
+    if (!allocateRange(mVertexBlock, vertexCount, entry.vertices, vertexOffset))
+    {
+        POLYPERROR("Geometry heap is out of vertex space for %u vertices", vertexCount);
+        return kInvalidMesh;
+    }
+
+    if (!allocateRange(mIndexBlock, indexCount, entry.indices, entry.mesh.firstIndex))
+    {
+        vmaVirtualFree(mVertexBlock, entry.vertices);
+        POLYPERROR("Geometry heap is out of index space for %u indices", indexCount);
+        return kInvalidMesh;
+    }
+
+    entry.mesh.vertexOffset = static_cast<int32_t>(vertexOffset);
+    entry.mesh.vertexCount  = vertexCount;
+    entry.mesh.indexCount   = indexCount;
+
+    if (!mFreeIds.empty())
+    {
+        auto id = mFreeIds.back();
+        mFreeIds.pop_back();
+        mEntries[id] = entry;
+        return id;
+    }
+
+    mEntries.push_back(entry);
+
+    return static_cast<MeshId>(mEntries.size() - 1);
+}
+
+void GeometryHeap::free(MeshId id)
+{
+    if (id >= mEntries.size() || mEntries[id].vertices == VK_NULL_HANDLE)
+        return;
+
+    auto& entry = mEntries[id];
+
+    mPendingFrees.push_back({ RHIContext::get().timeline().submitted() + 1, entry.vertices, entry.indices });
+
+    entry = {};
+    mFreeIds.push_back(id);
+}
+
+void GeometryHeap::bind(const CommandBuffer& cmd) const
+{
+    cmd.bindVertexBuffers(0, { *mVertexBuffer }, { VkDeviceSize{ 0 } });
+    cmd.bindIndexBuffer(*mIndexBuffer, 0, vk::IndexType::eUint32);
+}
+
+bool GeometryHeap::compact(const CommandBuffer& cmd)
+{
+    auto& ctx = RHIContext::get();
+
+    auto vertexBuffer = utils::createDeviceBuffer(static_cast<VkDeviceSize>(mStride) * mVertexCapacity, kVertexUsage);
+    auto indexBuffer  = utils::createDeviceBuffer(sizeof(uint32_t) * static_cast<VkDeviceSize>(mIndexCapacity), kIndexUsage);
+
+    if (*vertexBuffer == VK_NULL_HANDLE || *indexBuffer == VK_NULL_HANDLE)
+    {
+        POLYPERROR("Failed to create geometry heap buffers for compaction");
+        return false;
+    }
+
+    auto vertexBlock = createBlock(mVertexCapacity);
+    auto indexBlock  = createBlock(mIndexCapacity);
+
+    std::vector<Entry>          entries(mEntries.size());
+    std::vector<vk::BufferCopy> vertexRegions;
+    std::vector<vk::BufferCopy> indexRegions;
+    vertexRegions.reserve(meshCount());
+    indexRegions.reserve(meshCount());
+
+    // An empty block places the allocations one after another. The heap is left untouched until all fit.
+    for (size_t i = 0; i < mEntries.size(); ++i)
+    {
+        const auto& entry = mEntries[i];
+        if (entry.vertices == VK_NULL_HANDLE)
+            continue;
+
+        auto&    moved        = entries[i];
+        uint32_t vertexOffset = 0;
+
+        moved.mesh = entry.mesh;
+
+        if (!allocateRange(vertexBlock, entry.mesh.vertexCount, moved.vertices, vertexOffset) ||
+            !allocateRange(indexBlock, entry.mesh.indexCount, moved.indices, moved.mesh.firstIndex))
+        {
+            POLYPERROR("Failed to place mesh %zu in the compacted geometry heap", i);
+
+            vmaClearVirtualBlock(vertexBlock);
+            vmaClearVirtualBlock(indexBlock);
+            vmaDestroyVirtualBlock(vertexBlock);
+            vmaDestroyVirtualBlock(indexBlock);
+
+            return false;
+        }
+
+        moved.mesh.vertexOffset = static_cast<int32_t>(vertexOffset);
+
+        vertexRegions.push_back({ static_cast<VkDeviceSize>(entry.mesh.vertexOffset) * mStride,
+                                  static_cast<VkDeviceSize>(moved.mesh.vertexOffset) * mStride,
+                                  static_cast<VkDeviceSize>(entry.mesh.vertexCount)  * mStride });
+        indexRegions.push_back({ sizeof(uint32_t) * static_cast<VkDeviceSize>(entry.mesh.firstIndex),
+                                 sizeof(uint32_t) * static_cast<VkDeviceSize>(moved.mesh.firstIndex),
+                                 sizeof(uint32_t) * static_cast<VkDeviceSize>(entry.mesh.indexCount) });
+    }
+
+    mEntries = std::move(entries);
+
+    std::array<vk::MemoryBarrier, 1> barriers{};
+    barriers[0].srcAccessMask = vk::AccessFlagBits::eTransferWrite | vk::AccessFlagBits::eMemoryWrite;
+    barriers[0].dstAccessMask = vk::AccessFlagBits::eTransferRead;
+
+    cmd.pipelineBarrier(vk::PipelineStageFlagBits::eAllCommands, vk::PipelineStageFlagBits::eTransfer, {}, barriers, {}, {});
+
+    if (!vertexRegions.empty())
+    {
+        cmd.copyBuffer(*mVertexBuffer, *vertexBuffer, vertexRegions);
+        cmd.copyBuffer(*mIndexBuffer, *indexBuffer, indexRegions);
+    }
+
+    barriers[0].srcAccessMask = vk::AccessFlagBits::eTransferWrite;
+    barriers[0].dstAccessMask = vk::AccessFlagBits::eMemoryRead;
+
+    cmd.pipelineBarrier(vk::PipelineStageFlagBits::eTransfer, vk::PipelineStageFlagBits::eAllCommands, {}, barriers, {}, {});
+
+    // Pending frees belong to the old blocks, their ranges go away with the old buffers
+    mPendingFrees.clear();
+
+    vmaClearVirtualBlock(mVertexBlock);
+    vmaClearVirtualBlock(mIndexBlock);
+    vmaDestroyVirtualBlock(mVertexBlock);
+    vmaDestroyVirtualBlock(mIndexBlock);
+
+    mVertexBlock = vertexBlock;
+    mIndexBlock  = indexBlock;
+
+    ctx.retire(std::move(mVertexBuffer));
+    ctx.retire(std::move(mIndexBuffer));
+
+    mVertexBuffer = std::move(vertexBuffer);
+    mIndexBuffer  = std::move(indexBuffer);
+
+    mVertexBuffer.setMovable(true);
+    mIndexBuffer.setMovable(true);
+
+    ++mGeneration;
+
+    return true;
+}
+
+bool GeometryHeap::write(MeshId id, const void* vertices, const void* indices)
+{
+    auto& staging    = RHIContext::get().staging();
+    const auto& mesh = mEntries[id].mesh;
+
+    const VkDeviceSize vertexSize = static_cast<VkDeviceSize>(mesh.vertexCount) * mStride;
+    const VkDeviceSize indexSize  = static_cast<VkDeviceSize>(mesh.indexCount)  * sizeof(uint32_t);
+
+    auto vertexAllocation = staging.reserve(vertexSize);
+    if (!vertexAllocation)
+        return false;
+
+    std::memcpy(vertexAllocation.data, vertices, vertexSize);
+    staging.copy(vertexAllocation, mVertexBuffer, static_cast<VkDeviceSize>(mesh.vertexOffset) * mStride);
+
+    auto indexAllocation = staging.reserve(indexSize);
+    if (!indexAllocation)
+        return false;
+
+    std::memcpy(indexAllocation.data, indices, indexSize);
+    staging.copy(indexAllocation, mIndexBuffer, static_cast<VkDeviceSize>(mesh.firstIndex) * sizeof(uint32_t));
+
+    return true;
+}
+
+void GeometryHeap::collect()
+{
+    const auto& timeline = RHIContext::get().timeline();
+
+    while (!mPendingFrees.empty() && timeline.isCompleted(mPendingFrees.front().value))
+    {
+        vmaVirtualFree(mVertexBlock, mPendingFrees.front().vertices);
+        vmaVirtualFree(mIndexBlock, mPendingFrees.front().indices);
+        mPendingFrees.pop_front();
+    }
+}
+
+void GeometryHeap::destroy()
+{
+    mPendingFrees.clear();
+    mEntries.clear();
+    mFreeIds.clear();
+
+    if (mVertexBlock != VK_NULL_HANDLE)
+    {
+        vmaClearVirtualBlock(mVertexBlock);
+        vmaDestroyVirtualBlock(mVertexBlock);
+        mVertexBlock = VK_NULL_HANDLE;
+    }
+
+    if (mIndexBlock != VK_NULL_HANDLE)
+    {
+        vmaClearVirtualBlock(mIndexBlock);
+        vmaDestroyVirtualBlock(mIndexBlock);
+        mIndexBlock = VK_NULL_HANDLE;
+    }
+}
+
+}
+}
@@ -0,0 +1,117 @@
+#pragma once
+
+#include "vk_common.h"
+
+#include <deque>
+
+namespace polyp {
+namespace vulkan {
+
+/// One vertex and one index buffer shared by many meshes. Both are sub-allocated with VMA virtual
+/// blocks in units of vertices and indices, so a mesh location maps directly to the vertexOffset and
+/// firstIndex of an indexed draw and the buffers are bound once for all meshes.
+/// Mesh locations may change on compact(), so they are addressed by ids.
+class GeometryHeap
+{
+public:
+    using MeshId = uint32_t;
+
+    static constexpr MeshId kInvalidMesh = UINT32_MAX;
+
+    struct Mesh
+    {
+        int32_t  vertexOffset = 0;
+        uint32_t vertexCount  = 0;
+        uint32_t firstIndex   = 0;
+        uint32_t indexCount   = 0;
+    };
+
+    GeometryHeap(std::nullptr_t ptr)
+    { }
+
+    GeometryHeap(uint32_t vertexStride, uint32_t vertexCapacity, uint32_t indexCapacity);
+
+    GeometryHeap(const GeometryHeap&)            = delete;
+    GeometryHeap& operator=(const GeometryHeap&) = delete;
+
+    GeometryHeap(GeometryHeap&& rhv) noexcept;
+    GeometryHeap& operator=(GeometryHeap&& rhv) noexcept;
+
+    ~GeometryHeap();
+
+    MeshId allocate(uint32_t vertexCount, uint32_t indexCount);
+
+    /// Allocates a mesh and uploads its data through the staging ring
+    template<typename Vertex>
+    MeshId upload(const std::vector<Vertex>& vertices, const std::vector<uint32_t>& indices)
+    {
+        if (sizeof(Vertex) != mStride)
+        {
+            POLYPERROR("Vertex size %zu doesn't match the geometry heap stride %u", sizeof(Vertex), mStride);
+            return kInvalidMesh;
+        }
+
+        auto id = allocate(static_cast<uint32_t>(vertices.size()), static_cast<uint32_t>(indices.size()));
+        if (id != kInvalidMesh && !write(id, vertices.data(), indices.data()))
+        {
+            free(id);
+            return kInvalidMesh;
+        }
+
+        return id;
+    }
+
+    /// The mesh ranges are reused once the GPU is done with the frames which may draw it
+    void free(MeshId id);
+
+    const Mesh& mesh(MeshId id) const { return mEntries[id].mesh; }
+
+    void bind(const CommandBuffer& cmd) const;
+
+    /// Moves all the meshes to new tightly packed buffers, the copies are recorded into cmd.
+    /// Commands recorded with the old mesh locations must not be submitted after it.
+    /// Nothing changes if the meshes don't fit, false is returned then.
+    bool compact(const CommandBuffer& cmd);
+
+    /// Changes on every compact(), commands and copies of mesh() made before refer to the old locations and buffers
+    uint64_t generation() const noexcept { return mGeneration; }
+
+    uint32_t meshCount() const noexcept { return static_cast<uint32_t>(mEntries.size() - mFreeIds.size()); }
+
+    const Buffer& vertexBuffer() const noexcept { return mVertexBuffer; }
+    const Buffer& indexBuffer()  const noexcept { return mIndexBuffer; }
+
+private:
+    struct Entry
+    {
+        Mesh                 mesh     = {};
+        VmaVirtualAllocation vertices = VK_NULL_HANDLE;
+        VmaVirtualAllocation indices  = VK_NULL_HANDLE;
+    };
+
+    struct PendingFree
+    {
+        uint64_t             value    = 0; // device timeline value after which the ranges are unused
+        VmaVirtualAllocation vertices = VK_NULL_HANDLE;
+        VmaVirtualAllocation indices  = VK_NULL_HANDLE;
+    };
+
+    bool write(MeshId id, const void* vertices, const void* indices);
+    void collect();
+    void destroy();
+
+    Buffer                  mVertexBuffer   = { VK_NULL_HANDLE };
+    Buffer                  mIndexBuffer    = { VK_NULL_HANDLE };
+    VmaVirtualBlock         mVertexBlock    = VK_NULL_HANDLE;
+    VmaVirtualBlock         mIndexBlock     = VK_NULL_HANDLE;
+    uint32_t                mStride         = 0;
+    uint32_t                mVertexCapacity = 0;
+    uint32_t                mIndexCapacity  = 0;
+    std::vector<Entry>      mEntries;
+    std::vector<MeshId>     mFreeIds;
+    std::deque<PendingFree> mPendingFrees;
+    uint64_t                mGeneration     = 0;
+};
+
+}
+}
@@ -0,0 +1,157 @@
+#include "vk_profiler.h"
+#include "vk_context.h"
+
+#include <cstring>
+#include <sstream>
+
+namespace polyp {
+namespace vulkan {
+
+GPUProfiler::Scope::Scope(GPUProfiler& profiler, const CommandBuffer& cmd, const char* name) :
+    mProfiler(profiler), mCmd(cmd), mQuery(profiler.begin(cmd, name))
+{ }
+
+GPUProfiler::Scope::~Scope()
+{
+    mProfiler.end(mCmd, mQuery);
+}
+
+GPUProfiler::GPUProfiler(uint32_t frames, uint32_t queueFamily)
+{
+    const auto& ctx = RHIContext::get();
+
+    auto queueProps = ctx.gpu().getQueueFamilyProperties();
+    if (queueFamily >= queueProps.size() || queueProps[queueFamily].timestampValidBits == 0)
+    {
+        POLYPWARN("Queue family %u doesn't support timestamps, GPU profiler is disabled", queueFamily);
+        return;
+    }
+
+    const auto validBits = queueProps[queueFamily].timestampValidBits;
+
+    mTimestampMask   = validBits >= 64 ? UINT64_MAX : ((1ULL << validBits) - 1);
+    mTimestampPeriod = ctx.gpu().getProperties().limits.timestampPeriod;
+
+    vk::QueryPoolCreateInfo createInfo{};
+    createInfo.queryType  = vk::QueryType::eTimestamp;
+    createInfo.queryCount = kMaxScopes * 2;
+
+    mFrames.resize(frames);
+    for (auto& frame : mFrames)
+    {
+        frame.pool = ctx.device().createQueryPool(createInfo);
+        frame.pool.reset(0, createInfo.queryCount); // host reset, queries must be reset before the first use
+        frame.names.reserve(kMaxScopes);
+    }
+
+    mResults.resize(createInfo.queryCount);
+    mStats.reserve(kMaxScopes);
+}
+
+void GPUProfiler::beginFrame(uint32_t frameIndex)
+{
+    if (!enabled())
+        return;
+
+    mCurrFrame = frameIndex % mFrames.size();
+
+    resolve(mFrames[mCurrFrame]);
+}
+
+uint32_t GPUProfiler::begin(const CommandBuffer& cmd, const char* name)
+{
+    if (!enabled())
+        return UINT32_MAX;
+
+    auto& frame = mFrames[mCurrFrame];
+    if (frame.used + 2 > kMaxScopes * 2)
+    {
+        POLYPDEBUG("GPU profiler scope limit is reached, \"%s\" is not measured", name);
+        return UINT32_MAX;
+    }
+
+    auto query = frame.used;
+    frame.used += 2;
+    frame.names.push_back(name);
+
+    cmd.writeTimestamp(vk::PipelineStageFlagBits::eTopOfPipe, *frame.pool, query);
+
+    return query;
+}
+
+void GPUProfiler::end(const CommandBuffer& cmd, uint32_t query)
+{
+    if (query == UINT32_MAX)
+        return;
+
+    cmd.writeTimestamp(vk::PipelineStageFlagBits::eBottomOfPipe, *mFrames[mCurrFrame].pool, query + 1);
+}
+
+void GPUProfiler::resolve(Frame& frame)
+{
+    if (frame.used == 0)
+        return;
+
+    const auto& device = RHIContext::get().device();
+
+    // Raw call: the raii wrapper returns a freshly allocated vector every frame
+    auto res = static_cast<vk::Result>(device.getDispatcher()->vkGetQueryPoolResults(
+        static_cast<VkDevice>(*device), static_cast<VkQueryPool>(*frame.pool), 0, frame.used,
+        frame.used * sizeof(uint64_t), mResults.data(), sizeof(uint64_t), VK_QUERY_RESULT_64_BIT));
+
+    if (res == vk::Result::eSuccess)
+    {
+        for (uint32_t i = 0; i < frame.names.size(); ++i)
+        {
+            const auto start  = mResults[i * 2]     & mTimestampMask;
+            const auto finish = mResults[i * 2 + 1] & mTimestampMask;
+            const auto ms     = static_cast<float>((finish - start) & mTimestampMask) * mTimestampPeriod / 1e6f;
+
+            auto it = std::find_if(mStats.begin(), mStats.end(), [&frame, i](const auto& stats) {
+                return stats.name == frame.names[i] || std::strcmp(stats.name, frame.names[i]) == 0;
+            });
+
+            if (it == mStats.end())
+            {
+                mStats.push_back(ScopeStats{});
+                it = std::prev(mStats.end());
+                it->name = frame.names[i];
+            }
+
+            it->last               = ms;
+            it->samples[it->pos]   = ms;
+            it->pos                = (it->pos + 1) % kWindow;
+            it->count              = std::min(it->count + 1, kWindow);
+
+            float sum = 0.f;
+            it->max   = 0.f;
+            for (uint32_t s = 0; s < it->count; ++s)
+            {
+                sum    += it->samples[s];
+                it->max = std::max(it->max, it->samples[s]);
+            }
+            it->avg = sum / it->count;
+        }
+    }
+    else
+    {
+        POLYPDEBUG("GPU profiler results are not ready: %s", vk::to_string(res).c_str());
+    }
+
+    frame.pool.reset(0, frame.used);
+    frame.used = 0;
+    frame.names.clear();
+}
+
+std::string GPUProfiler::toString() const
+{
+    std::stringstream ss;
+
+    for (const auto& stats : mStats)
+        ss << stats.name << ": avg " << stats.avg << " ms, max " << stats.max << " ms; ";
+
+    return ss.str();
+}
+
+}
+}
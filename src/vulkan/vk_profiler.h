@@ -0,0 +1,89 @@
+#pragma once
+
+#include "vk_common.h"
+
+/// Measures the GPU time of the commands recorded into cmd until the end of the enclosing C++ scope
+#define POLYPGPUSCOPE(profiler, cmd, name) \
+polyp::vulkan::GPUProfiler::Scope POLYP_CONCAT(gpuScope, __LINE__){ profiler, cmd, name }
+
+namespace polyp {
+namespace vulkan {
+
+/// GPU timestamp profiler with a query pool per frame in flight.
+/// Results of a frame slot are read back when the slot is reused, i.e. after its
+/// frame has completed, so resolving never stalls.
+class GPUProfiler
+{
+public:
+    static constexpr uint32_t kMaxScopes = 64; // per frame
+    static constexpr uint32_t kWindow    = 64; // frames in the rolling statistics
+
+    struct ScopeStats
+    {
+        const char* name = nullptr;
+        float       last = 0.f; // ms
+        float        avg = 0.f; // ms, over the last kWindow frames
+        float        max = 0.f; // ms, over the last kWindow frames
+
+        std::array<float, kWindow> samples = {};
+        uint32_t                   count   = 0;
+        uint32_t                   pos     = 0;
+    };
+
+    class Scope
+    {
+    public:
+        Scope(GPUProfiler& profiler, const CommandBuffer& cmd, const char* name);
+        ~Scope();
+
+        Scope(const Scope&)            = delete;
+        Scope& operator=(const Scope&) = delete;
+
+    private:
+        GPUProfiler&         mProfiler;
+        const CommandBuffer& mCmd;
+        uint32_t             mQuery;
+    };
+
+    GPUProfiler(std::nullptr_t ptr)
+    { }
+
+    GPUProfiler(uint32_t frames, uint32_t queueFamily);
+
+    GPUProfiler(const GPUProfiler&)            = delete;
+    GPUProfiler& operator=(const GPUProfiler&) = delete;
+    GPUProfiler(GPUProfiler&&)                 = default;
+    GPUProfiler& operator=(GPUProfiler&&)      = default;
+
+    /// Resolves the queries previously written for the frame slot and starts a new frame in it.
+    /// The caller guarantees that the slot's previous frame has completed.
+    void beginFrame(uint32_t frameIndex);
+
+    bool enabled() const noexcept { return !mFrames.empty(); }
+
+    const std::vector<ScopeStats>& stats() const noexcept { return mStats; }
+
+    std::string toString() const;
+
+private:
+    struct Frame
+    {
+        QueryPool                pool   = { VK_NULL_HANDLE };
+        std::vector<const char*> names  = {};
+        uint32_t                 used   = 0; // queries, two per scope
+    };
+
+    uint32_t begin(const CommandBuffer& cmd, const char* name);
+    void     end(const CommandBuffer& cmd, uint32_t query);
+    void     resolve(Frame& frame);
+
+    std::vector<Frame>      mFrames;
+    std::vector<ScopeStats> mStats;
+    std::vector<uint64_t>   mResults;       // readback storage, reused every frame
+    uint32_t                mCurrFrame      = 0;
+    uint64_t                mTimestampMask  = 0;
+    float                   mTimestampPeriod = 0.f; // ns per tick
+};
+
+}
+}
@@ -0,0 +1,115 @@
+#include "vk_recorder.h"
+#include "vk_context.h"
+#include "vk_utils.h"
+
+#include <jobs.h>
+
+namespace polyp {
+namespace vulkan {
+
+ParallelRecorder::ParallelRecorder(uint32_t queueFamily, uint32_t threads, uint32_t frames)
+{
+    const auto& device = RHIContext::get().device();
+    const auto  slots  = JobSystem::get().slots();
+
+    if (threads == 0 || frames == 0)
+        return;
+
+    mThreads = std::min(threads, JobSystem::get().threads());
+
+    vk::CommandPoolCreateInfo cmdPoolCreateInfo{};
+    cmdPoolCreateInfo.queueFamilyIndex = queueFamily;
+    cmdPoolCreateInfo.flags            = vk::CommandPoolCreateFlagBits::eTransient;
+
+    // A thread may steal every range of a record(), so each pool gets a secondary per range up front
+    vk::CommandBufferAllocateInfo allocInfo{};
+    allocInfo.level              = vk::CommandBufferLevel::eSecondary;
+    allocInfo.commandBufferCount = mThreads;
+
+    mPools.resize(frames);
+    for (auto& framePools : mPools)
+    {
+        framePools.resize(slots);
+        for (auto& pool : framePools)
+        {
+            pool.pool = device.createCommandPool(cmdPoolCreateInfo);
+            if (*pool.pool == VK_NULL_HANDLE)
+            {
+                POLYPERROR("Failed to create recording command pools");
+                mPools.clear();
+                mThreads = 0;
+                return;
+            }
+
+            allocInfo.commandPool = *pool.pool;
+            pool.buffers          = device.allocateCommandBuffers(allocInfo);
+        }
+    }
+
+    mRecorded.resize(mThreads);
+}
+
+void ParallelRecorder::beginFrame(uint32_t frameIndex)
+{
+    if (mPools.empty())
+        return;
+
+    mFrameIndex = frameIndex;
+
+    for (auto& pool : mPools[frameIndex])
+    {
+        if (pool.used == 0)
+            continue;
+
+        pool.pool.reset();
+        pool.used = 0;
+    }
+}
+
+void ParallelRecorder::record(const CommandBuffer& primary, const vk::CommandBufferInheritanceInfo& inheritance,
+                              uint32_t count, uint32_t minItems, const RecordFn& fn)
+{
+    POLYPTRACE("Parallel record");
+    POLYPASSERT(!mPools.empty());
+
+    if (count == 0)
+        return;
+
+    const uint32_t ranges = std::clamp<uint32_t>(count / std::max(minItems, 1u), 1, mThreads);
+    const uint32_t size   = count / ranges;
+
+    JobSystem::get().parallelFor(ranges, 1, [&](uint32_t begin, uint32_t end) {
+        for (uint32_t range = begin; range < end; ++range)
+        {
+            const uint32_t first = size * range;
+            mRecorded[range] = recordRange(inheritance, first, range + 1 == ranges ? count - first : size, fn);
+        }
+    });
+
+    const vk::CommandBuffer* recorded = mRecorded.data();
+    primary.executeCommands(vk::ArrayProxy<const vk::CommandBuffer>(ranges, recorded));
+}
+
+vk::CommandBuffer ParallelRecorder::recordRange(const vk::CommandBufferInheritanceInfo& inheritance, uint32_t first, uint32_t count, const RecordFn& fn)
+{
+    // A thread runs one range at a time, so its pool is never used concurrently
+    auto& pool = mPools[mFrameIndex][JobSystem::get().threadIndex()];
+
+    if (pool.used == pool.buffers.size())
+        POLYPFATAL("Failed to allocate secondary command buffer.");
+
+    const auto& cmd = pool.buffers[pool.used++];
+
+    vk::CommandBufferBeginInfo beginInfo{};
+    beginInfo.flags            = vk::CommandBufferUsageFlagBits::eOneTimeSubmit | vk::CommandBufferUsageFlagBits::eRenderPassContinue;
+    beginInfo.pInheritanceInfo = &inheritance;
+
+    cmd.begin(beginInfo);
+    fn(cmd, first, count);
+    cmd.end();
+
+    return *cmd;
+}
+
+}
+}
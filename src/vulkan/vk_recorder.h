@@ -0,0 +1,58 @@
+#pragma once
+
+#include "vk_common.h"
+
+namespace polyp {
+namespace vulkan {
+
+/// Records the content of a render pass into secondary command buffers on the job system.
+/// Every job system thread has its own command pool per frame in flight, the pools of a frame are
+/// reset wholesale by beginFrame() instead of resetting each buffer. The secondaries are executed
+/// on the primary in range order.
+class ParallelRecorder
+{
+public:
+    /// Records the items [first, first + count) into a secondary command buffer. Called concurrently,
+    /// the secondary inherits nothing but the render pass, so it binds its own state.
+    using RecordFn = std::function<void(const CommandBuffer& cmd, uint32_t first, uint32_t count)>;
+
+    ParallelRecorder(std::nullptr_t ptr)
+    { }
+
+    /// At most threads ranges are recorded at once, 1 records everything on the calling thread
+    ParallelRecorder(uint32_t queueFamily, uint32_t threads, uint32_t frames);
+
+    ParallelRecorder(const ParallelRecorder&)            = delete;
+    ParallelRecorder& operator=(const ParallelRecorder&) = delete;
+    ParallelRecorder(ParallelRecorder&&)                 = default;
+    ParallelRecorder& operator=(ParallelRecorder&&)      = default;
+
+    uint32_t threads() const noexcept { return mThreads; }
+
+    /// Resets the command pools of the frame. The caller guarantees that the frame's previous submission has completed.
+    void beginFrame(uint32_t frameIndex);
+
+    /// Splits count items into ranges of at least minItems, threads() ranges at most, records them in parallel
+    /// and executes them on primary. The primary is inside the render pass of inheritance, begun with
+    /// SubpassContents::eSecondaryCommandBuffers.
+    void record(const CommandBuffer& primary, const vk::CommandBufferInheritanceInfo& inheritance,
+                uint32_t count, uint32_t minItems, const RecordFn& fn);
+
+private:
+    struct Pool
+    {
+        CommandPool                pool    = { VK_NULL_HANDLE };
+        std::vector<CommandBuffer> buffers = {};
+        size_t                     used    = 0; // buffers recorded in the current frame
+    };
+
+    vk::CommandBuffer recordRange(const vk::CommandBufferInheritanceInfo& inheritance, uint32_t first, uint32_t count, const RecordFn& fn);
+
+    std::vector<std::vector<Pool>> mPools;          // [frame][job system thread]
+    std::vector<vk::CommandBuffer> mRecorded;       // per range of the current record()
+    uint32_t                       mThreads    = 0;
+    uint32_t                       mFrameIndex = 0;
+};
+
+}
+}
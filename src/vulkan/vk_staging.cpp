@@ -0,0 +1,354 @@
+#include "vk_staging.h"
+#include "vk_context.h"
+#include "vk_utils.h"
+
+namespace polyp {
+namespace vulkan {
+
+namespace {
+
+uint64_t alignUp(uint64_t value, uint64_t alignment)
+{
+    return (value + alignment - 1) / alignment * alignment;
+}
+
+} // namespace
+
+StagingRing::StagingRing(vk::Queue queue, uint32_t queueFamily, uint32_t dstQueueFamily, VkDeviceSize size) :
+    mCapacity(size), mQueue(queue), mFamily(queueFamily), mDstFamily(dstQueueFamily)
+{
+    const auto& device = RHIContext::get().device();
+
+    mBuffer = utils::createUploadBuffer(size);
+    if (*mBuffer == VK_NULL_HANDLE || mBuffer.mappedData() == nullptr)
+    {
+        POLYPERROR("Failed to create staging ring of %llu bytes", static_cast<unsigned long long>(size));
+        mCapacity = 0;
+        return;
+    }
+
+    mMapped = static_cast<uint8_t*>(mBuffer.mappedData());
+
+    vk::CommandPoolCreateInfo cmdPoolCreateInfo{};
+    cmdPoolCreateInfo.queueFamilyIndex = queueFamily;
+    cmdPoolCreateInfo.flags            = vk::CommandPoolCreateFlagBits::eResetCommandBuffer |
+                                         vk::CommandPoolCreateFlagBits::eTransient;
+
+    mCmdPool  = device.createCommandPool(cmdPoolCreateInfo);
+    mTimeline = Timeline(device);
+}
+
+StagingRing& StagingRing::operator=(StagingRing&& rhv) noexcept
+{
+    if (this == &rhv)
+        return *this;
+
+    mBatches.clear(); // command buffers have to be freed while their pool is alive
+
+    mBuffer     = std::move(rhv.mBuffer);
+    mMapped     = std::exchange(rhv.mMapped, nullptr);
+    mCapacity   = std::exchange(rhv.mCapacity, 0);
+    mHead       = std::exchange(rhv.mHead, 0);
+    mTail       = std::exchange(rhv.mTail, 0);
+    mBatchBegin = std::exchange(rhv.mBatchBegin, 0);
+    mRegions    = std::move(rhv.mRegions);
+    mQueue      = std::exchange(rhv.mQueue, VK_NULL_HANDLE);
+    mFamily     = std::exchange(rhv.mFamily, VK_QUEUE_FAMILY_IGNORED);
+    mDstFamily  = std::exchange(rhv.mDstFamily, VK_QUEUE_FAMILY_IGNORED);
+
+    mBatchAcquires = std::exchange(rhv.mBatchAcquires, {});
+    mAcquires      = std::exchange(rhv.mAcquires, {});
+
+    mCmdPool    = std::move(rhv.mCmdPool);
+    mBatches    = std::move(rhv.mBatches);
+    mRecording  = std::exchange(rhv.mRecording, SIZE_MAX);
+    mTimeline   = std::move(rhv.mTimeline);
+
+    return *this;
+}
+
+StagingRing::Allocation StagingRing::reserve(VkDeviceSize size, VkDeviceSize alignment)
+{
+    if (size == 0 || size > mCapacity)
+    {
+        POLYPERROR("Staging ring can't reserve %llu bytes", static_cast<unsigned long long>(size));
+        return {};
+    }
+
+    uint64_t position = 0;
+
+    for (;;)
+    {
+        release();
+
+        position = alignUp(mHead, alignment);
+        if (position % mCapacity + size > mCapacity)
+            position = alignUp(position, mCapacity); // allocations never wrap, the tail of the ring is skipped
+
+        if (position + size - mTail <= mCapacity)
+            break;
+
+        // The current batch holds the rest of the ring, send it to be able to wait for it
+        if (mRegions.empty())
+            submit();
+
+        if (mRegions.empty())
+        {
+            POLYPERROR("Staging ring is exhausted by a single batch");
+            return {};
+        }
+
+        if (!mTimeline.wait(mRegions.front().value))
+            POLYPFATAL("Staging upload %llu has not been completed in time", static_cast<unsigned long long>(mRegions.front().value));
+    }
+
+    mHead = position + size;
+
+    const auto offset = position % mCapacity;
+
+    return { mMapped + offset, offset, size };
+}
+
+void StagingRing::copy(const Allocation& src, const Buffer& dst, VkDeviceSize dstOffset)
+{
+    const auto& cmd = recording();
+
+    vk::BufferCopy region{ src.offset, dstOffset, src.size };
+    cmd.copyBuffer(*mBuffer, *dst, { region });
+
+    if (ownershipTransfer())
+    {
+        vk::BufferMemoryBarrier barrier{};
+        barrier.srcAccessMask = vk::AccessFlagBits::eTransferWrite;
+        barrier.buffer        = *dst;
+        barrier.offset        = dstOffset;
+        barrier.size          = src.size;
+
+        releaseOwnership(cmd, barrier);
+    }
+}
+
+bool StagingRing::upload(const void* data, VkDeviceSize size, const Buffer& dst, VkDeviceSize dstOffset)
+{
+    const auto  chunk = std::max<VkDeviceSize>(mCapacity / 4, 1);
+    const auto* bytes = static_cast<const uint8_t*>(data);
+
+    for (VkDeviceSize offset = 0; offset < size; offset += chunk)
+    {
+        const auto chunkSize = std::min(chunk, size - offset);
+
+        auto allocation = reserve(chunkSize);
+        if (!allocation)
+            return false;
+
+        std::memcpy(allocation.data, bytes + offset, chunkSize);
+        copy(allocation, dst, dstOffset + offset);
+    }
+
+    return true;
+}
+
+void StagingRing::copy(const Allocation& src, vk::Image dst, const vk::BufferImageCopy& region, ImageLayout finalLayout)
+{
+    const auto& cmd = recording();
+
+    vk::ImageSubresourceRange range{};
+    range.aspectMask     = region.imageSubresource.aspectMask;
+    range.baseMipLevel   = region.imageSubresource.mipLevel;
+    range.levelCount     = 1;
+    range.baseArrayLayer = region.imageSubresource.baseArrayLayer;
+    range.layerCount     = region.imageSubresource.layerCount;
+
+    vk::ImageMemoryBarrier barrier{};
+    barrier.srcAccessMask       = vk::AccessFlagBits::eNone;
+    barrier.dstAccessMask       = vk::AccessFlagBits::eTransferWrite;
+    barrier.oldLayout           = vk::ImageLayout::eUndefined;
+    barrier.newLayout           = vk::ImageLayout::eTransferDstOptimal;
+    barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+    barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+    barrier.image               = dst;
+    barrier.subresourceRange    = range;
+
+    cmd.pipelineBarrier(vk::PipelineStageFlagBits::eTopOfPipe, vk::PipelineStageFlagBits::eTransfer, {}, {}, {}, { barrier });
+
+    auto copyRegion = region;
+    copyRegion.bufferOffset += src.offset;
+    cmd.copyBufferToImage(*mBuffer, dst, vk::ImageLayout::eTransferDstOptimal, { copyRegion });
+
+    barrier.srcAccessMask = vk::AccessFlagBits::eTransferWrite;
+    barrier.dstAccessMask = vk::AccessFlagBits::eNone;
+    barrier.oldLayout     = vk::ImageLayout::eTransferDstOptimal;
+    barrier.newLayout     = finalLayout;
+
+    if (ownershipTransfer())
+    {
+        releaseOwnership(cmd, barrier);
+        return;
+    }
+
+    // Access masks are completed by the global barrier at the end of the batch
+    cmd.pipelineBarrier(vk::PipelineStageFlagBits::eTransfer, vk::PipelineStageFlagBits::eTransfer, {}, {}, {}, { barrier });
+}
+
+uint64_t StagingRing::submit()
+{
+    if (mRecording == SIZE_MAX)
+        return mTimeline.submitted();
+
+    auto& batch = mBatches[mRecording];
+    mRecording  = SIZE_MAX;
+
+    if (!ownershipTransfer())
+    {
+        std::array<vk::MemoryBarrier, 1> barriers{};
+        barriers[0].srcAccessMask = vk::AccessFlagBits::eTransferWrite;
+        barriers[0].dstAccessMask = vk::AccessFlagBits::eMemoryRead | vk::AccessFlagBits::eMemoryWrite;
+
+        // Later submissions to the queue are ordered after the copies by this barrier, no semaphore is needed
+        batch.cmd.pipelineBarrier(vk::PipelineStageFlagBits::eTransfer, vk::PipelineStageFlagBits::eAllCommands, {}, barriers, {}, {});
+    }
+
+    batch.cmd.end();
+
+    flush(mBatchBegin, mHead);
+
+    batch.value = mTimeline.next();
+
+    vk::Semaphore semaphore = *mTimeline;
+
+    vk::TimelineSemaphoreSubmitInfo timelineInfo{};
+    timelineInfo.signalSemaphoreValueCount = 1;
+    timelineInfo.pSignalSemaphoreValues    = &batch.value;
+
+    vk::SubmitInfo submitInfo{};
+    submitInfo.pNext                = &timelineInfo;
+    submitInfo.commandBufferCount   = 1;
+    submitInfo.pCommandBuffers      = &*batch.cmd;
+    submitInfo.signalSemaphoreCount = 1;
+    submitInfo.pSignalSemaphores    = &semaphore;
+
+    mQueue.submit(submitInfo);
+
+    mRegions.push_back({ mHead, batch.value });
+    mBatchBegin = mHead;
+
+    if (!mBatchAcquires.buffers.empty() || !mBatchAcquires.images.empty())
+    {
+        mAcquires.buffers.insert(mAcquires.buffers.end(), mBatchAcquires.buffers.begin(), mBatchAcquires.buffers.end());
+        mAcquires.images.insert(mAcquires.images.end(), mBatchAcquires.images.begin(), mBatchAcquires.images.end());
+        mAcquires.value = batch.value;
+
+        mBatchAcquires.buffers.clear();
+        mBatchAcquires.images.clear();
+    }
+
+    return batch.value;
+}
+
+uint64_t StagingRing::acquire(const CommandBuffer& cmd)
+{
+    if (!hasAcquires())
+        return 0;
+
+    // The source stage chains with the semaphore wait of the consumer's submission
+    cmd.pipelineBarrier(vk::PipelineStageFlagBits::eAllCommands, vk::PipelineStageFlagBits::eAllCommands, {}, {},
+                        mAcquires.buffers, mAcquires.images);
+
+    const auto value = mAcquires.value;
+
+    mAcquires.buffers.clear();
+    mAcquires.images.clear();
+    mAcquires.value = 0;
+
+    return value;
+}
+
+void StagingRing::releaseOwnership(const CommandBuffer& cmd, vk::BufferMemoryBarrier barrier)
+{
+    barrier.srcQueueFamilyIndex = mFamily;
+    barrier.dstQueueFamilyIndex = mDstFamily;
+
+    // Destination access of a release is ignored, the acquire makes the data visible
+    cmd.pipelineBarrier(vk::PipelineStageFlagBits::eTransfer, vk::PipelineStageFlagBits::eBottomOfPipe, {}, {}, { barrier }, {});
+
+    barrier.srcAccessMask = vk::AccessFlagBits::eNone;
+    barrier.dstAccessMask = vk::AccessFlagBits::eMemoryRead;
+    mBatchAcquires.buffers.push_back(barrier);
+}
+
+void StagingRing::releaseOwnership(const CommandBuffer& cmd, vk::ImageMemoryBarrier barrier)
+{
+    barrier.srcQueueFamilyIndex = mFamily;
+    barrier.dstQueueFamilyIndex = mDstFamily;
+
+    cmd.pipelineBarrier(vk::PipelineStageFlagBits::eTransfer, vk::PipelineStageFlagBits::eBottomOfPipe, {}, {}, {}, { barrier });
+
+    // The acquire repeats the layout transition of the release
+    barrier.srcAccessMask = vk::AccessFlagBits::eNone;
+    barrier.dstAccessMask = vk::AccessFlagBits::eMemoryRead;
+    mBatchAcquires.images.push_back(barrier);
+}
+
+const CommandBuffer& StagingRing::recording()
+{
+    if (mRecording != SIZE_MAX)
+        return mBatches[mRecording].cmd;
+
+    for (size_t i = 0; i < mBatches.size() && mRecording == SIZE_MAX; ++i)
+    {
+        if (mTimeline.isCompleted(mBatches[i].value))
+            mRecording = i;
+    }
+
+    if (mRecording == SIZE_MAX)
+    {
+        mBatches.push_back({ utils::createCommandBuffer(mCmdPool, vk::CommandBufferLevel::ePrimary), 0 });
+        mRecording = mBatches.size() - 1;
+    }
+
+    auto& cmd = mBatches[mRecording].cmd;
+
+    vk::CommandBufferBeginInfo beginInfo{};
+    beginInfo.flags = vk::CommandBufferUsageFlagBits::eOneTimeSubmit;
+
+    cmd.reset();
+    cmd.begin(beginInfo);
+
+    return cmd;
+}
+
+void StagingRing::release()
+{
+    while (!mRegions.empty() && mTimeline.isCompleted(mRegions.front().value))
+    {
+        mTail = mRegions.front().end;
+        mRegions.pop_front();
+    }
+
+    // Nothing in flight and nothing pending: start from the beginning to keep allocations contiguous
+    if (mRegions.empty() && mTail == mHead && mBatchBegin == mHead)
+        mHead = mTail = mBatchBegin = 0;
+}
+
+void StagingRing::flush(uint64_t begin, uint64_t end) const
+{
+    if (begin == end)
+        return;
+
+    const auto first = begin % mCapacity;
+    const auto last  = (end - 1) % mCapacity + 1;
+
+    // Written range may wrap around the end of the ring
+    if (first < last && end - begin <= mCapacity)
+    {
+        mBuffer.flush(first, last - first);
+    }
+    else
+    {
+        mBuffer.flush(first, mCapacity - first);
+        mBuffer.flush(0, last);
+    }
+}
+
+}
+}
@@ -0,0 +1,122 @@
+#pragma once
+
+#include "vk_common.h"
+#include "vk_timeline.h"
+
+#include <deque>
+
+namespace polyp {
+namespace vulkan {
+
+/// Persistently mapped upload ring. Space is reserved and written by the host directly,
+/// copies into device-local resources are recorded into a batch that submit() sends at once.
+/// Every submitted batch is tracked with the ring's own timeline value, its region is reused
+/// once the value is reached, so repeated uploads neither allocate memory nor block the CPU
+/// unless the whole ring is in flight. Not thread-safe.
+///
+/// If the ring's queue family differs from the family the resources are used on, every copy
+/// releases the resource ownership to that family. The consumer records the matching acquire
+/// barriers with acquire() and waits for the returned value on the ring's timeline.
+class StagingRing
+{
+public:
+    struct Allocation
+    {
+        void*        data   = nullptr; // host pointer, valid until the batch is submitted
+        VkDeviceSize offset = 0;       // offset in the ring buffer
+        VkDeviceSize size   = 0;
+
+        explicit operator bool() const noexcept { return data != nullptr; }
+    };
+
+    StagingRing(std::nullptr_t ptr)
+    { }
+
+    StagingRing(vk::Queue queue, uint32_t queueFamily, uint32_t dstQueueFamily, VkDeviceSize size);
+
+    StagingRing(const StagingRing&)            = delete;
+    StagingRing& operator=(const StagingRing&) = delete;
+    StagingRing(StagingRing&&)                 = default;
+    StagingRing& operator=(StagingRing&& rhv) noexcept;
+
+    /// Returns a host-visible region for the current batch. Blocks only if the ring is exhausted.
+    Allocation reserve(VkDeviceSize size, VkDeviceSize alignment = 16);
+
+    void copy(const Allocation& src, const Buffer& dst, VkDeviceSize dstOffset = 0);
+
+    /// Copies into the image region, the image is transitioned from undefined to finalLayout
+    void copy(const Allocation& src, vk::Image dst, const vk::BufferImageCopy& region, ImageLayout finalLayout);
+
+    /// Writes and copies the data, data larger than a quarter of the ring goes in several chunks
+    bool upload(const void* data, VkDeviceSize size, const Buffer& dst, VkDeviceSize dstOffset = 0);
+
+    template<typename Container>
+    bool upload(const Container& data, const Buffer& dst, VkDeviceSize dstOffset = 0)
+    {
+        return upload(data.data(), sizeof(typename Container::value_type) * data.size(), dst, dstOffset);
+    }
+
+    /// Submits the recorded copies and returns the timeline value signaled on completion.
+    /// Without ownership transfer the copies are made visible to all later commands of the same queue.
+    uint64_t submit();
+
+    /// Records acquire barriers of the submitted copies into a command buffer of the destination family.
+    /// Returns the timeline value the submission of cmd has to wait for, 0 if there is nothing to acquire.
+    uint64_t acquire(const CommandBuffer& cmd);
+
+    bool ownershipTransfer() const noexcept { return mFamily != mDstFamily; }
+
+    bool hasAcquires() const noexcept { return mAcquires.value != 0; }
+
+    const Timeline& timeline() const noexcept { return mTimeline; }
+
+    VkDeviceSize capacity() const noexcept { return mCapacity; }
+
+private:
+    struct Region
+    {
+        uint64_t end   = 0; // ring position the region ends at
+        uint64_t value = 0; // timeline value of the batch using it
+    };
+
+    struct Batch
+    {
+        CommandBuffer cmd   = { VK_NULL_HANDLE };
+        uint64_t      value = 0;
+    };
+
+    struct Barriers
+    {
+        std::vector<vk::BufferMemoryBarrier> buffers;
+        std::vector<vk::ImageMemoryBarrier>  images;
+        uint64_t                             value = 0; // the latest batch the barriers belong to
+    };
+
+    void                 releaseOwnership(const CommandBuffer& cmd, vk::BufferMemoryBarrier barrier);
+    void                 releaseOwnership(const CommandBuffer& cmd, vk::ImageMemoryBarrier barrier);
+
+    const CommandBuffer& recording();
+    void                 release();
+    void                 flush(uint64_t begin, uint64_t end) const;
+
+    Buffer             mBuffer     = { VK_NULL_HANDLE };
+    uint8_t*           mMapped     = nullptr;
+    VkDeviceSize       mCapacity   = 0;
+    uint64_t           mHead       = 0; // monotonic ring positions, offset = position % capacity
+    uint64_t           mTail       = 0;
+    uint64_t           mBatchBegin = 0;
+    std::deque<Region> mRegions;
+
+    vk::Queue          mQueue      = VK_NULL_HANDLE;
+    uint32_t           mFamily     = VK_QUEUE_FAMILY_IGNORED;
+    uint32_t           mDstFamily  = VK_QUEUE_FAMILY_IGNORED;
+    Barriers           mBatchAcquires; // acquires of the batch being recorded
+    Barriers           mAcquires;      // acquires of submitted batches, not recorded by the consumer yet
+    CommandPool        mCmdPool    = { VK_NULL_HANDLE };
+    std::vector<Batch> mBatches;
+    size_t             mRecording  = SIZE_MAX; // batch being recorded
+    Timeline           mTimeline   = { VK_NULL_HANDLE };
+};
+
+}
+}
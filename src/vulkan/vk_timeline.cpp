@@ -0,0 +1,61 @@
+#include "vk_timeline.h"
+#include "vk_context.h"
+
+namespace polyp {
+namespace vulkan {
+
+Timeline::Timeline(const Device& device, uint64_t initialValue) :
+    mSemaphore(VK_NULL_HANDLE), mSubmitted(initialValue), mCompleted(initialValue)
+{
+    vk::SemaphoreTypeCreateInfo typeCreateInfo{};
+    typeCreateInfo.semaphoreType = vk::SemaphoreType::eTimeline;
+    typeCreateInfo.initialValue  = initialValue;
+
+    vk::SemaphoreCreateInfo createInfo{};
+    createInfo.pNext = &typeCreateInfo;
+
+    mSemaphore = device.createSemaphore(createInfo);
+}
+
+uint64_t Timeline::completed() const
+{
+    if (mCompleted < mSubmitted)
+        mCompleted = mSemaphore.getCounterValue();
+
+    return mCompleted;
+}
+
+bool Timeline::isCompleted(uint64_t value) const
+{
+    if (value <= mCompleted)
+        return true;
+
+    return value <= completed();
+}
+
+bool Timeline::wait(uint64_t value, uint64_t timeout) const
+{
+    if (isCompleted(value))
+        return true;
+
+    if (timeout == 0)
+        return false;
+
+    vk::Semaphore semaphore = *mSemaphore;
+
+    vk::SemaphoreWaitInfo waitInfo{};
+    waitInfo.semaphoreCount = 1;
+    waitInfo.pSemaphores    = &semaphore;
+    waitInfo.pValues        = &value;
+
+    auto res = RHIContext::get().device().waitSemaphores(waitInfo, timeout);
+    if (res == vk::Result::eTimeout)
+        return false;
+
+    mCompleted = std::max(mCompleted, value);
+
+    return true;
+}
+
+}
+}
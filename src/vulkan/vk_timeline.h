@@ -0,0 +1,70 @@
+#pragma once
+
+#include "vk_common.h"
+
+namespace polyp {
+namespace vulkan {
+
+/// Timeline semaphore with a monotonically increasing submit counter.
+/// Every queue submission signals a value reserved by next(), so any subsystem
+/// can tag its resources with that value and retire them once it is reached,
+/// without owning fences of its own.
+class Timeline
+{
+public:
+    Timeline(std::nullptr_t ptr) :
+        mSemaphore(ptr)
+    { }
+
+    Timeline(const Device& device, uint64_t initialValue = 0);
+
+    Timeline()                           = delete;
+    Timeline(const Timeline&)            = delete;
+    Timeline& operator=(const Timeline&) = delete;
+
+    Timeline(Timeline&& rhv) noexcept :
+        mSemaphore(std::move(rhv.mSemaphore))
+    {
+        std::swap(mSubmitted, rhv.mSubmitted);
+        std::swap(mCompleted, rhv.mCompleted);
+    }
+
+    Timeline& operator=(Timeline&& rhv) noexcept
+    {
+        mSemaphore = std::move(rhv.mSemaphore);
+
+        std::swap(mSubmitted, rhv.mSubmitted);
+        std::swap(mCompleted, rhv.mCompleted);
+
+        return *this;
+    }
+
+    vk::Semaphore operator*() const noexcept { return *mSemaphore; }
+
+    /// Reserves the value the next queue submission has to signal
+    uint64_t next() noexcept { return ++mSubmitted; }
+
+    /// The latest value handed out by next()
+    uint64_t submitted() const noexcept { return mSubmitted; }
+
+    /// The latest value reached by the GPU
+    uint64_t completed() const;
+
+    /// Non-blocking "has value X completed" query
+    bool isCompleted(uint64_t value) const;
+
+    /// Waits for the value on the host. Zero timeout makes it a non-blocking poll.
+    /// Returns true if the value has been reached.
+    bool wait(uint64_t value, uint64_t timeout = constants::kFenceTimeout) const;
+
+    /// Waits for every value handed out so far
+    bool waitIdle(uint64_t timeout = constants::kFenceTimeout) const { return wait(mSubmitted, timeout); }
+
+private:
+    Semaphore        mSemaphore = { VK_NULL_HANDLE };
+    uint64_t         mSubmitted = 0;
+    mutable uint64_t mCompleted = 0; // cached counter value, saves a driver call for already retired values
+};
+
+}
+}
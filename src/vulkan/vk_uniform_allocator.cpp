@@ -0,0 +1,62 @@
+#include "vk_uniform_allocator.h"
+#include "vk_context.h"
+#include "vk_utils.h"
+
+namespace polyp {
+namespace vulkan {
+
+namespace {
+
+VkDeviceSize alignUp(VkDeviceSize value, VkDeviceSize alignment)
+{
+    return (value + alignment - 1) / alignment * alignment;
+}
+
+} // namespace
+
+UniformAllocator::UniformAllocator(VkDeviceSize frameSize, uint32_t frames)
+{
+    const auto& ctx = RHIContext::get();
+
+    mAlignment = std::max<VkDeviceSize>(ctx.gpu().getProperties().limits.minUniformBufferOffsetAlignment, 1);
+    mFrameSize = alignUp(frameSize, mAlignment);
+
+    mBuffer = utils::createUploadBuffer(mFrameSize * frames, vk::BufferUsageFlagBits::eUniformBuffer, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT);
+    if (*mBuffer == VK_NULL_HANDLE || mBuffer.mappedData() == nullptr)
+    {
+        POLYPERROR("Failed to create uniform buffer of %llu bytes", static_cast<unsigned long long>(mFrameSize * frames));
+        mFrameSize = 0;
+        return;
+    }
+
+    mMapped = static_cast<uint8_t*>(mBuffer.mappedData());
+}
+
+void UniformAllocator::beginFrame(uint32_t frameIndex)
+{
+    mFrameBegin = mFrameSize * frameIndex;
+    mHead       = mFrameBegin;
+}
+
+UniformAllocator::Slice UniformAllocator::allocate(VkDeviceSize size)
+{
+    const auto offset = alignUp(mHead, mAlignment);
+    if (offset + size > mFrameBegin + mFrameSize)
+    {
+        POLYPERROR("Uniform frame region of %llu bytes is exhausted", static_cast<unsigned long long>(mFrameSize));
+        return {};
+    }
+
+    mHead = offset + size;
+
+    return { mMapped + offset, static_cast<uint32_t>(offset), size };
+}
+
+void UniformAllocator::flush() const
+{
+    if (mHead > mFrameBegin)
+        mBuffer.flush(mFrameBegin, mHead - mFrameBegin);
+}
+
+}
+}
@@ -0,0 +1,64 @@
+#pragma once
+
+#include "vk_common.h"
+
+namespace polyp {
+namespace vulkan {
+
+/// Linear allocator of per-frame constants over one persistently mapped buffer.
+/// The buffer is split into a region per frame in flight, a region is rewound by beginFrame()
+/// once its previous frame has completed. Slices are aligned to minUniformBufferOffsetAlignment,
+/// their offsets go directly to dynamic uniform buffer descriptors.
+class UniformAllocator
+{
+public:
+    struct Slice
+    {
+        void*        data   = nullptr;
+        uint32_t     offset = 0; // dynamic offset in buffer()
+        VkDeviceSize size   = 0;
+
+        explicit operator bool() const noexcept { return data != nullptr; }
+    };
+
+    UniformAllocator(std::nullptr_t ptr)
+    { }
+
+    UniformAllocator(VkDeviceSize frameSize, uint32_t frames);
+
+    UniformAllocator(const UniformAllocator&)            = delete;
+    UniformAllocator& operator=(const UniformAllocator&) = delete;
+    UniformAllocator(UniformAllocator&&)                 = default;
+    UniformAllocator& operator=(UniformAllocator&&)      = default;
+
+    /// Rewinds the frame region. The caller guarantees that the region's previous frame has completed.
+    void beginFrame(uint32_t frameIndex);
+
+    Slice allocate(VkDeviceSize size);
+
+    template<typename T>
+    Slice push(const T& data)
+    {
+        auto slice = allocate(sizeof(T));
+        if (slice)
+            std::memcpy(slice.data, &data, sizeof(T));
+
+        return slice;
+    }
+
+    /// Makes the frame's writes visible to the device, no-op for coherent memory
+    void flush() const;
+
+    const Buffer& buffer() const noexcept { return mBuffer; }
+
+private:
+    Buffer       mBuffer     = { VK_NULL_HANDLE };
+    uint8_t*     mMapped     = nullptr;
+    VkDeviceSize mAlignment  = 1;
+    VkDeviceSize mFrameSize  = 0;
+    VkDeviceSize mFrameBegin = 0;
+    VkDeviceSize mHead       = 0;
+};
+
+}
+}
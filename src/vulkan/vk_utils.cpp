@@ -21,7 +21,7 @@ RHIContext::CreateInfo getCreateInfo<RHIContext::CreateInfo>()
          RHIContext::CreateInfo::GPU::Powerful, // CreateInfo::GPU
          {NULL, NULL},                          // CreateInfo::Surface
          {queInfos, {}},                        // CreateInfo::Device
-         {3},                                   // CreateInfo::SwapChain
+         {3, 2},                                // CreateInfo::SwapChain
     };
 }
 
@@ -56,14 +56,13 @@ std::tuple<Image, ImageView> createDepthStencil()
 {
     const auto& gpu     = RHIContext::get().gpu();
     const auto& device  = RHIContext::get().device();
-    const auto& surface = RHIContext::get().surface();
 
     Image    image = VK_NULL_HANDLE;
     ImageView view = VK_NULL_HANDLE;
 
-    auto capabilities = gpu.getSurfaceCapabilitiesKHR(*surface);
-    const auto width  = capabilities.currentExtent.width;
-    const auto height = capabilities.currentExtent.height;
+    const auto extent = RHIContext::get().extent();
+    const auto width  = extent.width;
+    const auto height = extent.height;
 
     ImageCreateInfo imCreateInfo{};
     imCreateInfo.imageType   = vk::ImageType::e2D;
@@ -100,21 +99,21 @@ std::tuple<Image, ImageView> createDepthStencil()
 
 RenderPass createRenderPass()
 {
-    const auto& gpu       = RHIContext::get().gpu();
-    const auto& device    = RHIContext::get().device();
-    const auto& swapchain = RHIContext::get().swapchain();
+    const auto& ctx    = RHIContext::get();
+    const auto& gpu    = ctx.gpu();
+    const auto& device = ctx.device();
 
     std::array<vk::AttachmentDescription, 2> attachments = {};
 
     // Color attachment
-    attachments[0].format         = swapchain.getImageFormatPLP();
+    attachments[0].format         = ctx.colorFormat();
     attachments[0].samples        = vk::SampleCountFlagBits::e1;
     attachments[0].loadOp         = vk::AttachmentLoadOp::eClear;
     attachments[0].storeOp        = vk::AttachmentStoreOp::eStore;
     attachments[0].stencilLoadOp  = vk::AttachmentLoadOp::eDontCare;
     attachments[0].stencilStoreOp = vk::AttachmentStoreOp::eDontCare;
     attachments[0].initialLayout  = vk::ImageLayout::eUndefined;
-    attachments[0].finalLayout    = vk::ImageLayout::ePresentSrcKHR;
+    attachments[0].finalLayout    = ctx.presentLayout();
     // Depth attachment
     attachments[1].format         = gpu.getDepthFormatPLP();
     attachments[1].samples        = vk::SampleCountFlagBits::e1;
@@ -215,6 +214,24 @@ Buffer createDeviceBuffer(VkDeviceSize size, vk::BufferUsageFlags flags, VkMemor
     return device.createBufferPLP(createInfo, allocCreateInfo);
 }
 
+Buffer createReadbackBuffer(VkDeviceSize size, vk::BufferUsageFlags flags)
+{
+    if (size == 0)
+        return VK_NULL_HANDLE;
+
+    const auto& device = vulkan::RHIContext::get().device();
+
+    BufferCreateInfo createInfo;
+    createInfo.size  = size;
+    createInfo.usage = vk::BufferUsageFlagBits::eTransferDst | flags;
+
+    VmaAllocationCreateInfo allocCreateInfo = {};
+    allocCreateInfo.usage = VMA_MEMORY_USAGE_AUTO;
+    allocCreateInfo.flags = VMA_ALLOCATION_CREATE_MAPPED_BIT | VMA_ALLOCATION_CREATE_HOST_ACCESS_RANDOM_BIT;
+
+    return device.createBufferPLP(createInfo, allocCreateInfo);
+}
+
 ShaderModule loadSPIRV(std::string path)
 {
     std::ifstream is(path, std::ios::binary | std::ios::in | std::ios::ate);
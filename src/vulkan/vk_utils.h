@@ -23,6 +23,9 @@ Buffer createUploadBuffer(VkDeviceSize size, vk::BufferUsageFlags flags, VkMemor
 
 Buffer createDeviceBuffer(VkDeviceSize size, vk::BufferUsageFlags flags, VkMemoryPropertyFlags requiredFlags = 0);
 
+/// Persistently mapped buffer the device writes and the host reads back
+Buffer createReadbackBuffer(VkDeviceSize size, vk::BufferUsageFlags flags = {});
+
 ShaderModule loadSPIRV(std::string path);
 
 }